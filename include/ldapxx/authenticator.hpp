@@ -0,0 +1,165 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "connection_pool.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace ldapxx {
+
+/// Options for an authenticator.
+struct authenticator_options {
+	/// Maximum time to wait for a free connection, and for each bind response.
+	std::chrono::milliseconds timeout{5000};
+
+	/// How long a successful verification is remembered, or zero to disable the cache.
+	std::chrono::milliseconds cache_ttl{0};
+
+	/// Maximum number of remembered verifications.
+	std::size_t cache_size = 10000;
+};
+
+/// The outcome of verifying one set of credentials in a batch.
+struct verification {
+	/// The credentials are valid.
+	bool valid = false;
+
+	/// An error reported by the server for these credentials only, such as unwilling_to_perform for a locked account.
+	/**
+	 * Invalid credentials are not an error.
+	 */
+	std::error_code error;
+};
+
+/// Verify user credentials with simple binds on a dedicated connection pool.
+/**
+ * Each verification binds a pooled connection as the user,
+ * so verifications run concurrently up to the size of the pool.
+ * Connections are not bound as the service identity again after a verification.
+ * That only happens when a connection from pool() is acquired for use as the service identity.
+ *
+ * If enabled, successful verifications are cached for a short time.
+ * The cache only stores salted SHA-256 hashes of the DN and password, never the password itself.
+ * Note that a cached verification remains valid until it expires,
+ * even if the password is changed or the account is locked in the mean time.
+ *
+ * All member functions are thread-safe.
+ */
+class authenticator {
+	connection_pool pool_;
+	authenticator_options options_;
+	std::string salt_;
+
+	std::mutex cache_mutex_;
+	std::unordered_map<std::string, std::chrono::steady_clock::time_point> cache_;
+
+	/// Compute the cache key for a set of credentials.
+	std::string cache_key_(std::string_view dn, std::string_view password) const;
+
+	/// Check if a set of credentials was verified recently.
+	bool cached_(std::string const & key);
+
+	/// Remember a successful verification.
+	void remember_(std::string key);
+
+	/// Send a bind request for a set of credentials.
+	int send_bind_(connection_pool::lease & lease, std::string const & dn, std::string_view password, std::error_code & error);
+
+	/// Wait for the outcome of a bind request.
+	/**
+	 * The connection is discarded if its state is unknown afterwards.
+	 *
+	 * \return The result code of the bind, if the server responded.
+	 */
+	errc bind_outcome_(connection_pool::lease & lease, int message_id, std::error_code & error);
+
+public:
+	/// Create an authenticator with a dedicated connection pool.
+	/**
+	 * The service credentials are used for connections acquired from pool() with connection_pool::acquire().
+	 */
+	authenticator(
+		std::string uri,
+		connection_options const & connection_options,
+		std::size_t pool_size,
+		boost::optional<bind_credentials> service = boost::none,
+		authenticator_options options = {}
+	);
+
+	/// Get the connection pool.
+	/**
+	 * Connections acquired with connection_pool::acquire() are bound as the service identity,
+	 * so the pool can be used to look up user DNs as well.
+	 */
+	connection_pool & pool() { return pool_; }
+
+	/// Verify a DN and password.
+	/**
+	 * An empty password is always rejected,
+	 * since a simple bind with an empty password is an unauthenticated bind that succeeds for any DN.
+	 *
+	 * \return True if the credentials are valid, false if they are not.
+	 */
+	bool verify(std::string const & dn, std::string_view password);
+
+	/// Verify a DN and password, reporting errors through an error code.
+	/**
+	 * Invalid credentials are not an error.
+	 */
+	bool verify(std::string const & dn, std::string_view password, std::error_code & error);
+
+	/// Verify a number of credentials concurrently.
+	/**
+	 * Bind requests are sent on as many pooled connections as are available,
+	 * before waiting for any response.
+	 *
+	 * An error response from the server for one set of credentials is reported in its outcome,
+	 * and does not affect the other verifications.
+	 * Only errors that prevent the batch from completing, such as a lost connection, are thrown.
+	 *
+	 * \return The outcome of each verification, in the same order as the credentials.
+	 */
+	std::vector<verification> verify(std::vector<bind_credentials> const & credentials);
+
+	/// Verify a number of credentials concurrently, reporting errors through an error code.
+	/**
+	 * If the batch can not be completed, an empty vector is returned.
+	 */
+	std::vector<verification> verify(std::vector<bind_credentials> const & credentials, std::error_code & error);
+
+	/// Forget all cached verifications.
+	void clear_cache();
+};
+
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "error.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <system_error>
+
+namespace ldapxx {
+
+/// A flag to cancel operations from another thread.
+/**
+ * Operations that take operation_limits check the flag while waiting for a response.
+ * When it is set, the operation is abandoned on the server and fails with errc::user_cancelled.
+ */
+class cancellation {
+	std::atomic<bool> cancelled_{false};
+
+public:
+	/// Request cancellation of all operations using this flag.
+	/**
+	 * Safe to call from any thread.
+	 */
+	void cancel() { cancelled_.store(true, std::memory_order_release); }
+
+	/// Check if cancellation was requested.
+	bool cancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+	/// Clear the flag, so it can be used for new operations.
+	void reset() { cancelled_.store(false, std::memory_order_release); }
+};
+
+/// Compute the deadline for a timeout from now.
+/**
+ * Saturates at the maximum time point instead of overflowing,
+ * so a timeout of std::chrono::milliseconds::max() results in no deadline.
+ */
+inline std::chrono::steady_clock::time_point deadline_after(std::chrono::milliseconds timeout) {
+	using clock = std::chrono::steady_clock;
+	clock::time_point now = clock::now();
+	if (timeout >= std::chrono::duration_cast<std::chrono::milliseconds>(clock::time_point::max() - now)) return clock::time_point::max();
+	return now + timeout;
+}
+
+/// The deadline and cancellation flag for an operation.
+struct operation_limits {
+	using clock = std::chrono::steady_clock;
+
+	/// The time at which the operation is abandoned.
+	clock::time_point deadline = clock::time_point::max();
+
+	/// A flag to cancel the operation from another thread, or null.
+	cancellation const * cancel = nullptr;
+
+	/// How often the cancellation flag is checked while waiting for a response.
+	std::chrono::milliseconds poll_interval{10};
+
+	/// Create limits for an operation that must finish within a timeout from now.
+	static operation_limits after(std::chrono::milliseconds timeout, cancellation const * cancel = nullptr) {
+		operation_limits result;
+		result.deadline = deadline_after(timeout);
+		result.cancel   = cancel;
+		return result;
+	}
+
+	/// Check if the operation was cancelled.
+	bool cancelled() const { return cancel && cancel->cancelled(); }
+
+	/// Check if the operation has no deadline.
+	bool unlimited() const { return deadline == clock::time_point::max(); }
+
+	/// Get the time left until the deadline, rounded up to whole milliseconds.
+	/**
+	 * Returns zero if the deadline has passed,
+	 * and std::chrono::milliseconds::max() if there is no deadline.
+	 * Check for the latter before adding the result to a time point.
+	 */
+	std::chrono::milliseconds remaining() const {
+		if (unlimited()) return std::chrono::milliseconds::max();
+		clock::time_point now = clock::now();
+		if (now >= deadline) return std::chrono::milliseconds{0};
+		return std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+	}
+
+	/// Get the time limit to send to the server along with a request.
+	/**
+	 * Returns zero, meaning no limit, if there is no deadline.
+	 * Callers must check if the deadline has passed before sending the request,
+	 * because a passed deadline also results in zero.
+	 */
+	std::chrono::milliseconds time_limit() const {
+		return unlimited() ? std::chrono::milliseconds{0} : remaining();
+	}
+
+	/// Wait in slices until a step is done, the deadline passes or the operation is cancelled.
+	/**
+	 * The step is called with the time it may wait, and returns true when it is done.
+	 * With a cancellation flag, each slice is at most the poll interval.
+	 * Without one, slices are still bounded, so that huge timeouts don't overflow.
+	 *
+	 * \return True if the step is done, or false with the error set to timeout or user_cancelled.
+	 */
+	template<typename F>
+	bool wait_in_slices(F && step, std::error_code & error) const {
+		std::chrono::milliseconds max_slice = cancel ? std::max(poll_interval, std::chrono::milliseconds{1}) : std::chrono::hours{1};
+
+		while (true) {
+			if (cancelled()) {
+				error = errc::user_cancelled;
+				return false;
+			}
+
+			std::chrono::milliseconds left = remaining();
+			if (left.count() == 0) {
+				error = errc::timeout;
+				return false;
+			}
+
+			if (step(std::min(left, max_slice))) return true;
+		}
+	}
+};
+
+}
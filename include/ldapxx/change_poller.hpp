@@ -0,0 +1,128 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "connection.hpp"
+#include "types.hpp"
+#include "util.hpp"
+
+#include <ldap.h>
+
+#include <boost/optional.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+
+namespace ldapxx {
+
+/// Options for a change_poller.
+struct change_poller_options {
+	/// How far before the high-water mark each poll starts looking.
+	/**
+	 * This covers changes that were committed with an earlier timestamp than the last one seen,
+	 * for example because of clock skew between replicas or writes that were in flight during the previous poll.
+	 */
+	std::chrono::seconds overlap{60};
+
+	/// The operational attribute with the modification time.
+	/**
+	 * Active Directory uses "whenChanged" instead.
+	 */
+	std::string timestamp_attribute = "modifyTimestamp";
+
+	/// The operational attribute with a unique and stable entry identifier.
+	/**
+	 * Active Directory uses "objectGUID" instead.
+	 * Entries without it are identified by their DN.
+	 */
+	std::string uuid_attribute = "entryUUID";
+
+	/// Maximum number of entries returned by a single poll.
+	std::size_t max_response_size = default_max_response_size;
+};
+
+/// Poll for entries that changed since the previous poll, using the modification timestamp of entries.
+/**
+ * Each poll searches with the original query, restricted to entries modified at or after
+ * the high-water mark minus the overlap window.
+ * The high-water mark is the latest modification timestamp returned by the server,
+ * so the clock of the client does not matter.
+ *
+ * Entries found again in the overlap window are only reported if their timestamp changed.
+ * Changes within the same second as a reported change can be missed by servers with second granularity,
+ * if the timestamp of the entry does not change.
+ *
+ * Deleted entries are not reported, since they no longer match the query.
+ */
+class change_poller {
+	using time_point = std::chrono::system_clock::time_point;
+
+	ldapxx::connection connection_;
+	ldapxx::query query_;
+	change_poller_options options_;
+	boost::optional<time_point> high_water_;
+
+	/// Timestamps of entries reported within the overlap window, by identifier.
+	std::unordered_map<std::string, time_point> recent_;
+
+	/// Build the query for the next poll.
+	ldapxx::query make_query_() const;
+
+public:
+	/// Create a poller for a query.
+	/**
+	 * Without a high-water mark, the first poll reports all entries matching the query.
+	 * To resume from an earlier poller, pass its high_water_mark().
+	 * Entries in the overlap window are reported again after resuming, since the poller does not remember them.
+	 */
+	change_poller(ldapxx::connection connection, ldapxx::query query, change_poller_options options = {}, std::string const & high_water_mark = {});
+
+	/// Get the latest modification timestamp seen, as generalized time.
+	/**
+	 * Returns an empty string if no entry was seen yet.
+	 */
+	std::string high_water_mark() const;
+
+	/// Search for changed entries and invoke a callback for each of them.
+	/**
+	 * \return The number of reported entries.
+	 */
+	std::size_t poll(std::function<void (LDAP * connection, entry_t entry)> const & callback, operation_limits const & limits);
+
+	/// Search for changed entries and invoke a callback for each of them, reporting errors through an error code.
+	/**
+	 * If an error occurs, no entries are reported and the high-water mark is not changed.
+	 */
+	std::size_t poll(std::function<void (LDAP * connection, entry_t entry)> const & callback, operation_limits const & limits, std::error_code & error);
+};
+
+}
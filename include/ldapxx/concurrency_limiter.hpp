@@ -0,0 +1,179 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <system_error>
+
+namespace ldapxx {
+
+/// Options for a concurrency limiter.
+struct concurrency_limiter_options {
+	double initial_limit = 16;  ///< The initial number of requests allowed in flight.
+	double min_limit     = 1;   ///< The lower bound of the limit.
+	double max_limit     = 256; ///< The upper bound of the limit.
+
+	/// The amount the limit grows after a full limit's worth of successful requests.
+	double increase = 1;
+
+	/// The factor the limit is multiplied with when the server signals overload.
+	double backoff = 0.7;
+
+	/// If non-zero, requests slower than this are also treated as a signal of overload.
+	std::chrono::milliseconds latency_threshold{0};
+
+	/// Maximum number of callers that may wait for a free slot, excess callers are rejected immediately.
+	std::size_t max_queue = 64;
+};
+
+/// Statistics of a concurrency limiter.
+struct concurrency_limiter_stats {
+	double limit;              ///< The current limit.
+	std::size_t in_flight;     ///< The number of requests in flight.
+	std::size_t waiting;       ///< The number of callers waiting for a slot.
+	std::uint64_t rejected;    ///< The total number of rejected requests.
+	std::uint64_t overloads;   ///< The total number of times the limit was decreased.
+};
+
+/// An adaptive limit on the number of requests in flight to a server.
+/**
+ * The limit follows the AIMD scheme: it grows additively while requests succeed,
+ * and shrinks multiplicatively when the server signals overload
+ * with errc::busy, errc::unavailable, errc::admin_limit_exceeded, errc::timeout,
+ * or optionally with a latency above a threshold.
+ *
+ * Overload signals from requests that were started before the last decrease are ignored,
+ * so that a burst of failures only shrinks the limit once.
+ *
+ * Callers that find the limit reached wait in a bounded queue.
+ * When the queue is full, the request is rejected with errc::busy,
+ * and when the wait times out, with errc::timeout, without ever reaching the server.
+ *
+ * All member functions are thread-safe.
+ */
+class concurrency_limiter {
+	using clock = std::chrono::steady_clock;
+
+	concurrency_limiter_options options_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable released_;
+	double limit_;
+	std::size_t in_flight_  = 0;
+	std::size_t waiting_    = 0;
+	std::uint64_t generation_ = 0;
+	std::uint64_t rejected_ = 0;
+	std::uint64_t overloads_ = 0;
+
+	/// Check if a slot is free. The mutex must be held.
+	bool has_slot_() const;
+
+	/// Release a slot, and adjust the limit if feedback is given.
+	void release_(std::uint64_t generation, clock::duration latency, std::error_code const * error);
+
+public:
+	/// Permission to have a request in flight.
+	/**
+	 * The slot is released when the permit is destroyed.
+	 * Report the outcome of the request with complete() to let the limit adapt.
+	 */
+	class permit {
+		friend class concurrency_limiter;
+
+		concurrency_limiter * limiter_ = nullptr;
+		std::uint64_t generation_ = 0;
+		clock::time_point started_;
+
+	public:
+		permit() = default;
+
+		permit(permit && other) : limiter_{other.limiter_}, generation_{other.generation_}, started_{other.started_} {
+			other.limiter_ = nullptr;
+		}
+
+		permit & operator=(permit && other) {
+			if (this == &other) return *this;
+			release();
+			limiter_    = other.limiter_;
+			generation_ = other.generation_;
+			started_    = other.started_;
+			other.limiter_ = nullptr;
+			return *this;
+		}
+
+		~permit() { release(); }
+
+		/// Check if the permit holds a slot.
+		explicit operator bool() const { return limiter_; }
+
+		/// Report the outcome of the request and release the slot.
+		/**
+		 * The latency is measured from the moment the permit was granted.
+		 */
+		void complete(std::error_code const & error);
+
+		/// Release the slot without feedback.
+		void release();
+	};
+
+private:
+	/// Take a slot. The mutex must be held.
+	permit grant_();
+
+public:
+	/// Create a concurrency limiter.
+	explicit concurrency_limiter(concurrency_limiter_options options = {});
+
+	/// Get a slot, waiting at most the given time.
+	/**
+	 * A timeout of std::chrono::milliseconds::max() waits without limit,
+	 * so operation_limits::remaining() can be passed directly.
+	 *
+	 * Throws an error with errc::busy if the queue is full, or with errc::timeout if the wait times out.
+	 */
+	permit acquire(std::chrono::milliseconds timeout);
+
+	/// Get a slot, waiting at most the given time, reporting rejection through an error code.
+	permit acquire(std::chrono::milliseconds timeout, std::error_code & error);
+
+	/// Get a slot if one is available without waiting.
+	/**
+	 * \return An empty permit if the limit is reached.
+	 */
+	permit try_acquire();
+
+	/// Check if a slot is available without waiting.
+	bool available() const;
+
+	/// Get the statistics of the limiter.
+	concurrency_limiter_stats stats() const;
+};
+
+}
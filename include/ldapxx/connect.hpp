@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "connection.hpp"
+#include "types.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace ldapxx {
+
+/// The outcome of a connection attempt.
+struct connect_result {
+	owned_connection connection; ///< The opened connection, or null if the attempt failed.
+	std::error_code error;       ///< The reason the attempt failed.
+};
+
+/// Open a connection to an LDAP server within a deadline.
+/**
+ * Unlike the connection constructor, this actually opens the connection,
+ * and performs the STARTTLS command if options.tls.starttls is set.
+ *
+ * The timeout bounds the whole attempt: the TCP connect, the STARTTLS round-trip and the TLS handshake.
+ * If options.ldap.network_timeout is shorter, it still limits the individual network steps.
+ * A timeout of std::chrono::milliseconds::max() means no deadline, so operation_limits::remaining() can be passed directly.
+ */
+owned_connection connect(std::string const & uri, connection_options const & options, std::chrono::milliseconds timeout);
+
+/// Open a connection to an LDAP server within a deadline, reporting errors through an error code.
+owned_connection connect(std::string const & uri, connection_options const & options, std::chrono::milliseconds timeout, std::error_code & error);
+
+/// Open a number of connections in parallel.
+/**
+ * Each attempt runs with its own deadline, as for connect(),
+ * and at most max_parallel attempts are in progress at the same time.
+ * A failed attempt does not affect the other attempts.
+ *
+ * The URIs don't have to be distinct, to open several connections to the same server.
+ *
+ * \return The outcome of each attempt, in the same order as the URIs.
+ */
+std::vector<connect_result> connect_parallel(
+	std::vector<std::string> const & uris,
+	connection_options const & options,
+	std::chrono::milliseconds timeout,
+	std::size_t max_parallel = 16
+);
+
+}
@@ -25,6 +25,8 @@
  */
 
 #pragma once
+#include "cancellation.hpp"
+#include "modification_buffer.hpp"
 #include "options.hpp"
 #include "types.hpp"
 
@@ -34,11 +36,17 @@
 
 #include <chrono>
 #include <map>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <vector>
 
 namespace ldapxx {
 
+class tls_context;
+class tls_session_cache;
+
 /// Connection options.
 /**
  * When default constructed, only the LDAP protocol version will be set to 3.
@@ -74,6 +82,22 @@ struct connection_options {
 		boost::optional<std::string>    keyfile      = boost::none;
 		boost::optional<tls_protocol_t> protocol_min = boost::none;
 		boost::optional<std::string>    random_file  = boost::none;
+
+		/// A pre-built TLS context to share between connections.
+		/**
+		 * If set, the CA certificates, CRL, key and cipher suite options are not applied to each connection,
+		 * since the context already contains them.
+		 * Only require_cert is still applied, because it also controls the host name check.
+		 *
+		 * See tls_context.
+		 */
+		std::shared_ptr<tls_context const> context = nullptr;
+
+		/// A cache of TLS sessions to resume, to allow abbreviated handshakes.
+		/**
+		 * See tls_session_cache.
+		 */
+		std::shared_ptr<tls_session_cache> session_cache = nullptr;
 	} tls;
 };
 
@@ -110,6 +134,16 @@ void apply_options(LDAP * connection, connection_options const & options);
  * as used by the C API. This means that it is safe to copy the connection.
  *
  * For convenience, the connection is implicitly convertable to the native C handle.
+ *
+ * Operations throw an ldapxx::error on failure.
+ * Each operation also has an overload that takes a std::error_code
+ * and reports failures through it instead of throwing.
+ * Those overloads do not allocate for the error,
+ * which makes them suitable for routine outcomes such as a missing entry.
+ *
+ * Operations that take operation_limits are sent asynchronously.
+ * If the deadline passes or the operation is cancelled before the response arrives,
+ * the operation is abandoned on the server and fails with errc::timeout or errc::user_cancelled.
  */
 class connection {
 	/// The native handle.
@@ -145,6 +179,19 @@ public:
 	/// Perform a simple bind with a DN and a password.
 	void simple_bind(std::string const & dn, std::string_view password);
 
+	/// Perform a simple bind with a DN and a password, reporting errors through an error code.
+	void simple_bind(std::string const & dn, std::string_view password, std::error_code & error);
+
+	/// Perform a simple bind with a DN and a password within limits.
+	/**
+	 * A bind can not be abandoned, so if it times out or is cancelled,
+	 * the bind state of the connection is unknown and the connection should be closed.
+	 */
+	void simple_bind(std::string const & dn, std::string_view password, operation_limits const & limits);
+
+	/// Perform a simple bind with a DN and a password within limits, reporting errors through an error code.
+	void simple_bind(std::string const & dn, std::string_view password, operation_limits const & limits, std::error_code & error);
+
 	/// Perform a search query.
 	/**
 	 * The returned result is automatically wrapped in a unique_ptr with the appropriate deleter.
@@ -155,29 +202,259 @@ public:
 		std::size_t max_response_size = default_max_response_size
 	);
 
+	/// Perform a search query, reporting errors through an error code.
+	/**
+	 * The returned result is automatically wrapped in a unique_ptr with the appropriate deleter.
+	 *
+	 * The result may contain partial results if an error occured,
+	 * for example if the size limit was exceeded.
+	 */
+	owned_result search(
+		query const & query,
+		std::chrono::milliseconds timeout,
+		std::size_t max_response_size,
+		std::error_code & error
+	);
+
+	/// Perform a search query, reporting errors through an error code.
+	owned_result search(query const & query, std::chrono::milliseconds timeout, std::error_code & error) {
+		return search(query, timeout, default_max_response_size, error);
+	}
+
+	/// Perform a search query within limits.
+	/**
+	 * The time left until the deadline is also sent to the server as time limit.
+	 */
+	owned_result search(
+		query const & query,
+		operation_limits const & limits,
+		std::size_t max_response_size = default_max_response_size
+	);
+
+	/// Perform a search query within limits, reporting errors through an error code.
+	owned_result search(
+		query const & query,
+		operation_limits const & limits,
+		std::size_t max_response_size,
+		std::error_code & error
+	);
+
+	/// Start a search query.
+	/**
+	 * A non-zero time limit is sent to the server, rounded up to whole seconds.
+	 * A zero time limit means no limit.
+	 * If the query has sort keys, the sort control is sent along with the given server controls.
+	 *
+	 * \return The message ID of the request, to be passed to wait_result().
+	 */
+	int search_async(
+		query const & query,
+		std::chrono::milliseconds time_limit = std::chrono::milliseconds{0},
+		std::size_t max_response_size = default_max_response_size,
+		LDAPControl * * server_controls = nullptr
+	);
+
+	/// Start a search query, reporting errors through an error code.
+	int search_async(
+		query const & query,
+		std::chrono::milliseconds time_limit,
+		std::size_t max_response_size,
+		LDAPControl * * server_controls,
+		std::error_code & error
+	);
+
 	/// Apply a number of modifications to an LDAP entry.
 	/**
 	 * The modifications are performed in the order specified.
 	 */
 	void modify(std::string const & dn, std::vector<modification> const & modifications);
 
+	/// Apply a number of modifications to an LDAP entry, reporting errors through an error code.
+	void modify(std::string const & dn, std::vector<modification> const & modifications, std::error_code & error);
+
+	/// Apply the modifications from a modification buffer to an LDAP entry.
+	/**
+	 * The modifications are performed in the order they were added to the buffer.
+	 * The buffer is not cleared, so that it can be re-used by the caller.
+	 */
+	void modify(std::string const & dn, modification_buffer & modifications);
+
+	/// Apply the modifications from a modification buffer to an LDAP entry, reporting errors through an error code.
+	void modify(std::string const & dn, modification_buffer & modifications, std::error_code & error);
+
+	/// Apply the modifications from a modification buffer to an LDAP entry within limits.
+	void modify(std::string const & dn, modification_buffer & modifications, operation_limits const & limits);
+
+	/// Apply the modifications from a modification buffer to an LDAP entry within limits, reporting errors through an error code.
+	void modify(std::string const & dn, modification_buffer & modifications, operation_limits const & limits, std::error_code & error);
+
 	/// Add an attribute value to an LDAP entry.
 	/**
 	 * The attribute will be created if needed (and if possible).
 	 */
 	void add_attribute_value(std::string const & dn, std::string const & attribute, std::string_view value);
 
+	/// Add an attribute value to an LDAP entry, reporting errors through an error code.
+	void add_attribute_value(std::string const & dn, std::string const & attribute, std::string_view value, std::error_code & error);
+
 	/// Delete an attribute value from an LDAP entry.
 	void remove_attribute_value(std::string const & dn, std::string const & attribute, std::string_view value);
 
+	/// Delete an attribute value from an LDAP entry, reporting errors through an error code.
+	void remove_attribute_value(std::string const & dn, std::string const & attribute, std::string_view value, std::error_code & error);
+
 	/// Delete an attribute from an LDAP entry.
 	void remove_attribute(std::string const & dn, std::string const & attribute);
 
+	/// Delete an attribute from an LDAP entry, reporting errors through an error code.
+	void remove_attribute(std::string const & dn, std::string const & attribute, std::error_code & error);
+
 	/// Add an entry to the LDAP directory.
 	void add_entry(std::string const & dn, std::map<std::string, std::vector<std::string>> const & attributes);
 
+	/// Add an entry to the LDAP directory, reporting errors through an error code.
+	void add_entry(std::string const & dn, std::map<std::string, std::vector<std::string>> const & attributes, std::error_code & error);
+
+	/// Add an entry to the LDAP directory with the attributes from a modification buffer.
+	/**
+	 * The buffer should contain only modifications of type modification_type::add.
+	 * The buffer is not cleared, so that it can be re-used by the caller.
+	 */
+	void add_entry(std::string const & dn, modification_buffer & attributes);
+
+	/// Add an entry to the LDAP directory with the attributes from a modification buffer, reporting errors through an error code.
+	void add_entry(std::string const & dn, modification_buffer & attributes, std::error_code & error);
+
+	/// Add an entry to the LDAP directory with the attributes from a modification buffer within limits.
+	void add_entry(std::string const & dn, modification_buffer & attributes, operation_limits const & limits);
+
+	/// Add an entry to the LDAP directory with the attributes from a modification buffer within limits, reporting errors through an error code.
+	void add_entry(std::string const & dn, modification_buffer & attributes, operation_limits const & limits, std::error_code & error);
+
 	/// Delete an entry from the LDAP directory.
 	void remove_entry(std::string const & dn);
+
+	/// Delete an entry from the LDAP directory, reporting errors through an error code.
+	void remove_entry(std::string const & dn, std::error_code & error);
+
+	/// Delete an entry from the LDAP directory within limits.
+	void remove_entry(std::string const & dn, operation_limits const & limits);
+
+	/// Delete an entry from the LDAP directory within limits, reporting errors through an error code.
+	void remove_entry(std::string const & dn, operation_limits const & limits, std::error_code & error);
+
+	/// Start applying the modifications from a modification buffer to an LDAP entry.
+	/**
+	 * The request is fully encoded before this function returns,
+	 * so the buffer may be re-used immediately.
+	 *
+	 * \return The message ID of the request, to be passed to wait_result().
+	 */
+	int modify_async(std::string const & dn, modification_buffer & modifications, LDAPControl * * server_controls = nullptr);
+
+	/// Start applying the modifications from a modification buffer to an LDAP entry, reporting errors through an error code.
+	int modify_async(std::string const & dn, modification_buffer & modifications, LDAPControl * * server_controls, std::error_code & error);
+
+	/// Start adding an entry to the LDAP directory with the attributes from a modification buffer.
+	/**
+	 * The request is fully encoded before this function returns,
+	 * so the buffer may be re-used immediately.
+	 *
+	 * \return The message ID of the request, to be passed to wait_result().
+	 */
+	int add_entry_async(std::string const & dn, modification_buffer & attributes, LDAPControl * * server_controls = nullptr);
+
+	/// Start adding an entry to the LDAP directory with the attributes from a modification buffer, reporting errors through an error code.
+	int add_entry_async(std::string const & dn, modification_buffer & attributes, LDAPControl * * server_controls, std::error_code & error);
+
+	/// Start deleting an entry from the LDAP directory.
+	/**
+	 * \return The message ID of the request, to be passed to wait_result().
+	 */
+	int remove_entry_async(std::string const & dn, LDAPControl * * server_controls = nullptr);
+
+	/// Start deleting an entry from the LDAP directory, reporting errors through an error code.
+	int remove_entry_async(std::string const & dn, LDAPControl * * server_controls, std::error_code & error);
+
+	/// Compare an attribute value of an entry with a given value.
+	/**
+	 * This is a lot cheaper than a search when only a yes or no answer is needed,
+	 * such as when checking group membership.
+	 *
+	 * \return True if the entry has the attribute value, false otherwise.
+	 */
+	bool compare(std::string const & dn, std::string const & attribute, std::string_view value);
+
+	/// Compare an attribute value of an entry with a given value, reporting errors through an error code.
+	/**
+	 * A false outcome of the comparison is not an error.
+	 */
+	bool compare(std::string const & dn, std::string const & attribute, std::string_view value, std::error_code & error);
+
+	/// Compare an attribute value of an entry with a given value within limits.
+	bool compare(std::string const & dn, std::string const & attribute, std::string_view value, operation_limits const & limits);
+
+	/// Compare an attribute value of an entry with a given value within limits, reporting errors through an error code.
+	bool compare(std::string const & dn, std::string const & attribute, std::string_view value, operation_limits const & limits, std::error_code & error);
+
+	/// Compare a number of attribute values in one batch.
+	/**
+	 * All compare requests are sent before waiting for any response.
+	 * The timeout applies to the batch as a whole.
+	 *
+	 * The connection should not have other outstanding requests while the batch is running.
+	 *
+	 * \return The outcome of each comparison, in the same order as the requests.
+	 */
+	std::vector<bool> compare(std::vector<compare_request> const & requests, std::chrono::milliseconds timeout);
+
+	/// Compare a number of attribute values in one batch, reporting errors through an error code.
+	/**
+	 * If an error occurs, an empty vector is returned.
+	 */
+	std::vector<bool> compare(std::vector<compare_request> const & requests, std::chrono::milliseconds timeout, std::error_code & error);
+
+	/// Start comparing an attribute value of an entry with a given value.
+	/**
+	 * \return The message ID of the request, to be passed to compare_result().
+	 */
+	int compare_async(std::string const & dn, std::string const & attribute, std::string_view value);
+
+	/// Start comparing an attribute value of an entry with a given value, reporting errors through an error code.
+	int compare_async(std::string const & dn, std::string const & attribute, std::string_view value, std::error_code & error);
+
+	/// Wait for the result of an asynchronous compare request.
+	/**
+	 * \return True if the entry has the attribute value, false otherwise.
+	 */
+	bool compare_result(int message_id, std::chrono::milliseconds timeout);
+
+	/// Wait for the result of an asynchronous compare request, reporting errors through an error code.
+	bool compare_result(int message_id, std::chrono::milliseconds timeout, std::error_code & error);
+
+	/// Wait for the complete result of an asynchronous request.
+	/**
+	 * The returned result is automatically wrapped in a unique_ptr with the appropriate deleter.
+	 */
+	owned_result wait_result(int message_id, std::chrono::milliseconds timeout);
+
+	/// Wait for the complete result of an asynchronous request, reporting errors through an error code.
+	/**
+	 * A timeout is reported as errc::timeout.
+	 */
+	owned_result wait_result(int message_id, std::chrono::milliseconds timeout, std::error_code & error);
+
+	/// Wait for the complete result of an asynchronous request within limits.
+	/**
+	 * If the deadline passes or the operation is cancelled, the request is abandoned.
+	 */
+	owned_result wait_result(int message_id, operation_limits const & limits);
+
+	/// Wait for the complete result of an asynchronous request within limits, reporting errors through an error code.
+	/**
+	 * A timeout is reported as errc::timeout, a cancellation as errc::user_cancelled.
+	 */
+	owned_result wait_result(int message_id, operation_limits const & limits, std::error_code & error);
 };
 
 }
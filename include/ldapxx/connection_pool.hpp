@@ -0,0 +1,229 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "connection.hpp"
+
+#include <ldap.h>
+
+#include <boost/optional.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ldapxx {
+
+/// Credentials for a simple bind.
+struct bind_credentials {
+	std::string dn;
+	std::string password;
+};
+
+/// A thread-safe pool of connections to a single LDAP server.
+/**
+ * Unlike ldapxx::connection, the pool owns its connections and unbinds them when they are destroyed.
+ * Connections are opened lazily, up to the configured maximum size.
+ *
+ * If service credentials are given, every connection is bound with them before it is handed out by acquire().
+ * Users that bind a leased connection as a different identity must call mark_rebound() on the lease.
+ * Such a connection is only bound as the service identity again when it is needed for that,
+ * so that a connection used purely for verifying credentials is never bound twice per verification.
+ *
+ * All leases must be returned before the pool is destroyed.
+ */
+class connection_pool {
+public:
+	class lease;
+
+private:
+	/// A pooled connection with its bookkeeping.
+	struct slot {
+		LDAP * ldap;
+		bool rebound;
+	};
+
+	std::string uri_;
+	connection_options options_;
+	boost::optional<bind_credentials> service_;
+	std::size_t max_size_;
+
+	std::mutex mutex_;
+	std::condition_variable released_;
+	std::vector<slot> idle_;
+	std::size_t size_ = 0;
+
+	/// Lease a connection, waiting until the deadline if one is given.
+	/**
+	 * If wait is false, an empty lease is returned immediately when no connection is available.
+	 */
+	lease acquire_(boost::optional<std::chrono::steady_clock::time_point> deadline, bool wait, bool service_identity);
+
+	/// Open a new connection.
+	slot open_();
+
+	/// Bind a connection as the service identity if that is needed.
+	void prepare_(slot & slot, bool service_identity);
+
+	/// Return a connection to the pool.
+	void release_(slot slot);
+
+	/// Close a connection and forget about it.
+	void discard_(slot slot);
+
+public:
+	/// A leased connection.
+	/**
+	 * The connection is returned to the pool when the lease is destroyed.
+	 */
+	class lease {
+		friend class connection_pool;
+
+		connection_pool * pool_ = nullptr;
+		slot slot_{nullptr, false};
+
+		lease(connection_pool * pool, slot slot) : pool_{pool}, slot_{slot} {}
+
+	public:
+		lease() = default;
+		lease(lease const &) = delete;
+		lease & operator=(lease const &) = delete;
+
+		lease(lease && other) : pool_{other.pool_}, slot_{other.slot_} {
+			other.pool_ = nullptr;
+		}
+
+		lease & operator=(lease && other) {
+			if (this == &other) return *this;
+			reset();
+			pool_ = other.pool_;
+			slot_ = other.slot_;
+			other.pool_ = nullptr;
+			return *this;
+		}
+
+		~lease() { reset(); }
+
+		/// Check if the lease holds a connection.
+		explicit operator bool() const { return pool_; }
+
+		/// Get the leased connection.
+		ldapxx::connection connection() const { return slot_.ldap; }
+
+		/// Get the native handle of the leased connection.
+		LDAP * native() const { return slot_.ldap; }
+
+		/// Allow implicit conversion to the native C API handle.
+		operator LDAP * () const { return native(); }
+
+		/// Note that the connection was bound as a different identity than the service identity.
+		void mark_rebound() { slot_.rebound = true; }
+
+		/// Return the connection to the pool.
+		void reset() {
+			if (pool_) pool_->release_(slot_);
+			pool_ = nullptr;
+		}
+
+		/// Close the connection instead of returning it to the pool.
+		/**
+		 * Use this when the connection is broken, for example after errc::server_down.
+		 * The pool will open a new connection when it needs one.
+		 */
+		void discard() {
+			if (pool_) pool_->discard_(slot_);
+			pool_ = nullptr;
+		}
+	};
+
+	/// Create a connection pool.
+	/**
+	 * No connections are opened until they are needed.
+	 */
+	connection_pool(
+		std::string uri,
+		connection_options options,
+		std::size_t max_size,
+		boost::optional<bind_credentials> service = boost::none
+	);
+
+	connection_pool(connection_pool const &) = delete;
+	connection_pool & operator=(connection_pool const &) = delete;
+
+	/// Close all idle connections.
+	~connection_pool();
+
+	/// Get the maximum number of connections in the pool.
+	std::size_t max_size() const { return max_size_; }
+
+	/// Open a number of new connections in parallel, to avoid opening them one by one on demand.
+	/**
+	 * No more connections are opened than fit in the pool.
+	 * The timeout applies to each connection attempt separately.
+	 *
+	 * \return The number of connections that were opened successfully.
+	 */
+	std::size_t warm_up(std::size_t count, std::chrono::milliseconds timeout);
+
+	/// Lease a connection bound as the service identity, waiting until one is available.
+	lease acquire();
+
+	/// Lease a connection bound as the service identity, waiting at most the given time.
+	/**
+	 * A timeout of std::chrono::milliseconds::max() waits without limit,
+	 * so operation_limits::remaining() can be passed directly.
+	 *
+	 * \return An empty lease if no connection became available in time.
+	 */
+	lease acquire(std::chrono::milliseconds timeout);
+
+	/// Lease a connection bound as the service identity, if one is available without waiting for another lease.
+	/**
+	 * If there is no idle connection but the pool is not full yet, a new connection is opened.
+	 *
+	 * \return An empty lease if no connection is available.
+	 */
+	lease try_acquire();
+
+	/// Lease a connection without caring which identity it is bound as, waiting at most the given time.
+	/**
+	 * This avoids a bind for users that bind the connection themselves anyway.
+	 *
+	 * \return An empty lease if no connection became available in time.
+	 */
+	lease acquire_unbound(std::chrono::milliseconds timeout);
+
+	/// Lease a connection without caring which identity it is bound as, if one is available without waiting.
+	/**
+	 * \return An empty lease if no connection is available.
+	 */
+	lease try_acquire_unbound();
+};
+
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "connection_pool.hpp"
+#include "types.hpp"
+
+#include <boost/optional.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace ldapxx {
+
+/// Options for a directory_crawler.
+struct crawler_options {
+	/// Number of worker threads, each using its own pooled connection.
+	std::size_t threads = 4;
+
+	/// The attributes to retrieve for each entry.
+	std::vector<std::string> attributes = {"*"};
+
+	/// Maximum number of entries returned for a single container.
+	std::size_t max_response_size = default_max_response_size;
+
+	/// Descend into entries when the server does not report whether they have children.
+	/**
+	 * Servers without the hasSubordinates attribute, such as Active Directory, need this to crawl at all.
+	 * It costs one extra search per leaf entry.
+	 */
+	bool descend_unknown = true;
+};
+
+/// Statistics of a directory_crawler.
+struct crawler_stats {
+	std::size_t entries    = 0; ///< Entries passed to the consumer.
+	std::size_t containers = 0; ///< One-level searches performed.
+	std::size_t steals     = 0; ///< Containers taken from the queue of another worker.
+};
+
+/// Visit all entries below a set of base DNs with one-level searches from multiple threads.
+/**
+ * Each container is searched with a separate one-level search, so no single search hits the size or time limits
+ * of the server, and memory use is bounded by the largest container instead of the whole tree.
+ *
+ * Every worker has its own queue of containers to search.
+ * A worker takes work from the back of its own queue, and steals from the front of other queues when its own queue is empty.
+ * Stolen containers are close to the base, so they tend to have large subtrees, which keeps the number of steals low.
+ *
+ * The frontier of the crawl can be saved with checkpoint() at any time, also while the crawl is running.
+ * A new crawler started with the saved frontier continues where the old one stopped.
+ * Entries of containers that were being searched when the checkpoint was taken are visited again.
+ */
+class directory_crawler {
+public:
+	/// The consumer receives every entry below the base DNs.
+	/**
+	 * It is called from multiple worker threads at the same time, so it must be thread-safe.
+	 */
+	using consumer = std::function<void (LDAP * connection, entry_t entry)>;
+
+private:
+	struct worker {
+		std::mutex mutex;
+		std::deque<std::string> queue;
+		boost::optional<std::string> current;
+	};
+
+	connection_pool & pool_;
+	crawler_options options_;
+	std::vector<std::unique_ptr<worker>> workers_;
+
+	std::mutex idle_mutex_;
+	std::condition_variable idle_;
+	std::atomic<std::size_t> queued_{0};
+	std::atomic<std::size_t> pending_{0};
+	std::atomic<bool> stop_{false};
+
+	std::mutex error_mutex_;
+	std::error_code error_;
+	std::exception_ptr exception_;
+
+	std::atomic<std::size_t> entries_{0};
+	std::atomic<std::size_t> containers_{0};
+	std::atomic<std::size_t> steals_{0};
+
+	/// Run a worker thread until the crawl is done or stopped.
+	void work_(std::size_t index, consumer const & consumer, operation_limits const & limits);
+
+	/// Take a container to search, from the own queue or from another worker.
+	bool take_(std::size_t index);
+
+	/// Search a container, report its children and queue the children that are containers.
+	void crawl_(std::size_t index, connection_pool::lease & lease, consumer const & consumer, operation_limits const & limits, std::error_code & error);
+
+	/// Stop all workers because of an error.
+	void fail_(std::error_code error, std::exception_ptr exception = nullptr);
+
+	/// Wake up idle workers.
+	void wake_();
+
+public:
+	/// Create a crawler for the entries below a set of base DNs.
+	/**
+	 * To resume an interrupted crawl, pass the result of checkpoint() as base DNs.
+	 * The base entries themselves are not passed to the consumer.
+	 */
+	directory_crawler(connection_pool & pool, std::vector<std::string> const & bases, crawler_options options = {});
+
+	directory_crawler(directory_crawler const &) = delete;
+	directory_crawler & operator=(directory_crawler const &) = delete;
+
+	/// Crawl until all entries are visited, an error occurs or the limits are exceeded.
+	/**
+	 * If the consumer throws, the crawl is stopped and the exception is rethrown.
+	 * After an error, the crawl can be continued by calling run() again.
+	 */
+	void run(consumer const & consumer, operation_limits const & limits);
+
+	/// Crawl until all entries are visited, reporting errors through an error code.
+	void run(consumer const & consumer, operation_limits const & limits, std::error_code & error);
+
+	/// Check if all entries have been visited.
+	bool done() const { return pending_.load() == 0; }
+
+	/// Get the containers that still need to be searched.
+	/**
+	 * Safe to call from any thread, also while the crawl is running.
+	 */
+	std::vector<std::string> checkpoint();
+
+	/// Get the statistics of the crawl.
+	crawler_stats stats() const;
+};
+
+}
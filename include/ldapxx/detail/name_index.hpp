@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ldapxx {
+
+/// Open addressing hash table from names to IDs, compared case insensitively.
+/**
+ * All names are stored in a single buffer, and slots only hold offsets into it,
+ * so a table for a few thousand names needs a handful of allocations.
+ *
+ * Used internally for the schema and attribute name interning.
+ */
+class name_index {
+	struct slot {
+		std::uint32_t hash   = 0;
+		std::uint32_t id     = 0xffffffff;
+		std::uint32_t offset = 0;
+		std::uint32_t length = 0;
+	};
+
+	std::vector<slot> slots_;
+	std::string names_;
+	std::size_t size_ = 0;
+
+	/// Find the slot for a name: either the slot holding it, or the empty slot where it belongs.
+	std::size_t find_slot_(std::string_view name, std::uint32_t hash) const;
+
+	/// Rehash into a table with a given number of slots, which must be a power of two.
+	void rehash_(std::size_t capacity);
+
+public:
+	static constexpr std::uint32_t no_id = 0xffffffff;
+
+	/// Make room for a number of names with a total length, without rehashing.
+	void reserve(std::size_t count, std::size_t bytes = 0);
+
+	/// Add a name with an ID, unless the name is already present.
+	/**
+	 * \return The ID of the name: the given ID if it was added, or the existing ID.
+	 */
+	std::uint32_t insert(std::string_view name, std::uint32_t id);
+
+	/// Find the ID of a name, or no_id if the name is not present.
+	std::uint32_t find(std::string_view name) const;
+
+	/// Get the number of names in the table.
+	std::size_t size() const { return size_; }
+
+	/// Remove all names.
+	void clear();
+};
+
+}
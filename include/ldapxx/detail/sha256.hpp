@@ -0,0 +1,85 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace ldapxx {
+
+/// Incremental SHA-256 hash.
+/**
+ * Used internally for hashing secrets, so they don't have to be kept in memory.
+ *
+ * If ldapxx was built with OpenSSL, the OpenSSL implementation is used,
+ * which uses the SHA extensions of the CPU where available.
+ * Otherwise a portable implementation is used.
+ */
+class sha256 {
+public:
+	using digest = std::array<std::uint8_t, 32>;
+
+private:
+	/// The OpenSSL digest context, if ldapxx was built with OpenSSL.
+	/**
+	 * The portable state is kept either way, so the layout doesn't depend on the build options.
+	 */
+	void * native_ = nullptr;
+
+	std::array<std::uint32_t, 8> state_;
+	std::array<std::uint8_t, 64> block_;
+	std::size_t block_size_ = 0;
+	std::uint64_t length_   = 0;
+
+	void process_block_();
+
+public:
+	sha256();
+	~sha256();
+
+	sha256(sha256 const &) = delete;
+	sha256 & operator=(sha256 const &) = delete;
+
+	/// Add data to the hash.
+	void update(std::string_view data);
+
+	/// Finish the hash and return the digest.
+	/**
+	 * The hash must not be updated afterwards.
+	 */
+	digest finish();
+};
+
+/// Compute the SHA-256 digest of a string.
+inline sha256::digest sha256_digest(std::string_view data) {
+	sha256 hash;
+	hash.update(data);
+	return hash.finish();
+}
+
+}
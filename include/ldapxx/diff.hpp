@@ -0,0 +1,106 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "connection.hpp"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace ldapxx {
+
+/// The difference between the current and the desired values of an attribute.
+/**
+ * The views refer to the attribute names and values the diff was computed from.
+ */
+struct attribute_diff {
+	std::string_view attribute;            ///< The attribute name.
+	std::vector<std::string_view> added;   ///< Values to add.
+	std::vector<std::string_view> removed; ///< Values to remove.
+	bool remove_attribute = false;         ///< If true, the whole attribute should be removed.
+};
+
+/// Compute the minimal changes needed to bring an entry from the current to the desired state.
+/**
+ * Only the attributes that appear in the desired state are compared,
+ * other attributes of the current entry are left alone.
+ * An attribute that appears in the desired state without values is removed completely.
+ *
+ * Attribute names are compared case insensitively, values are compared exactly.
+ *
+ * The returned diff refers to the strings in the current and desired state,
+ * so they must outlive the diff.
+ */
+std::vector<attribute_diff> diff_entry(
+	std::multimap<std::string, std::string> const & current,
+	std::map<std::string, std::vector<std::string>> const & desired
+);
+
+/// Compute the minimal changes needed to bring an entry from the current to the desired state.
+/**
+ * See the other overload for details.
+ */
+std::vector<attribute_diff> diff_entry(
+	std::map<std::string, std::vector<std::string>> const & current,
+	std::map<std::string, std::vector<std::string>> const & desired
+);
+
+/// Apply a diff to an entry.
+/**
+ * The changes are sent in one or more modify requests,
+ * each with at most max_values values, so that huge attributes don't result in huge requests.
+ * Removals of an attribute are sent before additions.
+ * The changes for one attribute are kept in a single request if they fit.
+ * Otherwise, one removal is held back until after the additions,
+ * so that an attribute never loses all its values while the changes are being applied.
+ *
+ * Note that the entry is only updated atomically if all changes fit in a single request.
+ */
+void apply_entry_diff(
+	connection & connection,
+	std::string const & dn,
+	std::vector<attribute_diff> const & diff,
+	std::size_t max_values = 1000
+);
+
+/// Apply a diff to an entry, reporting errors through an error code.
+/**
+ * When an error occurs, no further requests are sent,
+ * but requests that were already sent are not rolled back.
+ */
+void apply_entry_diff(
+	connection & connection,
+	std::string const & dn,
+	std::vector<attribute_diff> const & diff,
+	std::size_t max_values,
+	std::error_code & error
+);
+
+}
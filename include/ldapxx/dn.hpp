@@ -0,0 +1,166 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "types.hpp"
+
+#include <boost/optional.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace ldapxx {
+
+/// Normalize a distinguished name according to RFC 4514.
+/**
+ * The normalized form of the input is appended to the output string.
+ * Attribute types are lowercased and values are unescaped and re-escaped canonically.
+ * Leading, trailing and repeated spaces in values are insignificant and are removed or collapsed.
+ * Values are compared case insensitively, so they are lowercased too (ASCII only).
+ * The attribute value assertions of multi-valued RDNs are sorted.
+ *
+ * The parser itself does not allocate memory,
+ * so if the output has enough capacity no allocations are performed at all.
+ *
+ * \return False if the input is not a valid DN, in which case the output is left untouched.
+ */
+bool normalize_dn(std::string_view input, std::string & output);
+
+/// Compute a stable hash of a normalized DN.
+/**
+ * The hash is a 64 bit FNV-1a hash of the normalized DN,
+ * so it does not depend on the platform or on the process.
+ */
+constexpr std::uint64_t hash_dn(std::string_view normalized) {
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	for (char c : normalized) {
+		hash ^= std::uint8_t(c);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+/// Get the parent of a normalized DN.
+/**
+ * Returns an empty view if the DN has no parent.
+ */
+std::string_view dn_parent(std::string_view normalized);
+
+/// Get the first RDN of a normalized DN.
+std::string_view dn_rdn(std::string_view normalized);
+
+/// Count the number of RDNs in a normalized DN.
+std::size_t dn_depth(std::string_view normalized);
+
+/// Check if a normalized DN is a strict ancestor of another normalized DN.
+bool dn_is_ancestor(std::string_view ancestor, std::string_view descendant);
+
+/// Check if a normalized DN is the direct parent of another normalized DN.
+bool dn_is_parent(std::string_view parent, std::string_view child);
+
+/// A normalized distinguished name.
+/**
+ * The DN is stored in normalized form together with the hash of the normalized form,
+ * which makes it suitable as a key for hash maps and ordered maps alike.
+ */
+class dn {
+	std::string normalized_;
+	std::uint64_t hash_;
+
+	struct normalized_tag {};
+	dn(std::string normalized, normalized_tag);
+
+public:
+	/// Construct an empty DN, referring to the root DSE.
+	dn();
+
+	/// Parse and normalize a DN.
+	/**
+	 * \throw error with errc::invalid_dn_syntax if the DN can not be parsed.
+	 */
+	explicit dn(std::string_view input);
+
+	/// Parse and normalize a DN without throwing.
+	/**
+	 * Returns boost::none if the DN can not be parsed.
+	 */
+	static boost::optional<dn> parse(std::string_view input);
+
+	/// Get the normalized DN as string.
+	std::string const & str() const { return normalized_; }
+
+	/// Get the hash of the normalized DN.
+	std::uint64_t hash() const { return hash_; }
+
+	/// Check if the DN is empty (refers to the root DSE).
+	bool empty() const { return normalized_.empty(); }
+
+	/// Count the number of RDNs in the DN.
+	std::size_t depth() const { return dn_depth(normalized_); }
+
+	/// Get the first RDN of the DN in normalized form.
+	std::string_view rdn() const { return dn_rdn(normalized_); }
+
+	/// Get the parent of the DN.
+	/**
+	 * The parent of a single RDN is the empty DN.
+	 * The parent of the empty DN is the empty DN.
+	 */
+	dn parent() const;
+
+	/// Check if this DN is the direct parent of another DN.
+	bool is_parent_of(dn const & other) const { return dn_is_parent(normalized_, other.normalized_); }
+
+	/// Check if this DN is a direct child of another DN.
+	bool is_child_of(dn const & other) const { return dn_is_parent(other.normalized_, normalized_); }
+
+	/// Check if this DN is a strict ancestor of another DN.
+	bool is_ancestor_of(dn const & other) const { return dn_is_ancestor(normalized_, other.normalized_); }
+
+	/// Check if this DN is a strict descendant of another DN.
+	bool is_descendant_of(dn const & other) const { return dn_is_ancestor(other.normalized_, normalized_); }
+
+	friend bool operator==(dn const & a, dn const & b) { return a.hash_ == b.hash_ && a.normalized_ == b.normalized_; }
+	friend bool operator!=(dn const & a, dn const & b) { return !(a == b); }
+	friend bool operator< (dn const & a, dn const & b) { return a.normalized_ <  b.normalized_; }
+};
+
+/// Check if an entry falls within the scope of a search.
+/**
+ * This can be used to determine which cached search results are affected by a write to an entry.
+ */
+bool in_scope(dn const & base, ldapxx::scope scope, dn const & entry);
+
+}
+
+namespace std {
+	template<> struct hash<ldapxx::dn> {
+		std::size_t operator() (ldapxx::dn const & dn) const noexcept { return std::size_t(dn.hash()); }
+	};
+}
@@ -40,6 +40,8 @@ enum class errc {
 	protocol_error                 = LDAP_PROTOCOL_ERROR,
 	time_limit_exceeded            = LDAP_TIMELIMIT_EXCEEDED,
 	size_limit_exceeded            = LDAP_SIZELIMIT_EXCEEDED,
+	compare_false                  = LDAP_COMPARE_FALSE,
+	compare_true                   = LDAP_COMPARE_TRUE,
 	auth_method_not_supported      = LDAP_AUTH_METHOD_NOT_SUPPORTED,
 	stronger_auth_required         = LDAP_STRONG_AUTH_REQUIRED,
 	referral                       = LDAP_REFERRAL,
@@ -119,6 +121,21 @@ public:
 	}
 };
 
+/// Throw an error if the error code is set.
+/**
+ * Takes a C string to avoid allocating a message when there is no error.
+ */
+inline void throw_if(std::error_code const & error, char const * details) {
+	if (error) throw ldapxx::error{errc(error.value()), details};
+}
+
+/// Get the result code of the last operation on a connection without throwing.
+inline errc last_result_code(LDAP * connection) {
+	int code = LDAP_OTHER;
+	ldap_get_option(connection, LDAP_OPT_RESULT_CODE, &code);
+	return errc(code);
+}
+
 }
 
 namespace std {
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace ldapxx {
+
+/// Find the first byte in a value that must be escaped in a search filter.
+/**
+ * These are the bytes `*`, `(`, `)`, `\` and NUL as specified by RFC 4515.
+ *
+ * \return The index of the first byte that must be escaped, or std::string_view::npos if there is none.
+ */
+std::size_t find_filter_special(std::string_view input);
+
+/// Find the first byte in a value that must be escaped in a DN.
+/**
+ * These are the bytes `"`, `+`, `,`, `;`, `<`, `>`, `\` and NUL as specified by RFC 4514.
+ * Leading `#` and leading or trailing spaces must also be escaped, but are not reported by this function.
+ *
+ * \return The index of the first byte that must be escaped, or std::string_view::npos if there is none.
+ */
+std::size_t find_dn_special(std::string_view input);
+
+/// Escape a value for use in a search filter.
+/**
+ * If nothing needs to be escaped, the input is returned as-is and the buffer is not touched.
+ * Otherwise, the escaped value is written to the buffer, replacing the contents,
+ * and a view of the buffer is returned.
+ *
+ * Re-using the same buffer for many values avoids all allocations once the buffer is large enough.
+ */
+std::string_view escape_filter_value(std::string_view input, std::string & buffer);
+
+/// Escape a value for use as attribute value in a DN.
+/**
+ * If nothing needs to be escaped, the input is returned as-is and the buffer is not touched.
+ * Otherwise, the escaped value is written to the buffer, replacing the contents,
+ * and a view of the buffer is returned.
+ *
+ * Re-using the same buffer for many values avoids all allocations once the buffer is large enough.
+ */
+std::string_view escape_dn_value(std::string_view input, std::string & buffer);
+
+/// Escape a value for use in a search filter, returning a new string.
+inline std::string escape_filter_value(std::string_view input) {
+	std::string buffer;
+	return std::string{escape_filter_value(input, buffer)};
+}
+
+/// Escape a value for use as attribute value in a DN, returning a new string.
+inline std::string escape_dn_value(std::string_view input) {
+	std::string buffer;
+	return std::string{escape_dn_value(input, buffer)};
+}
+
+}
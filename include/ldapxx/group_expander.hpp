@@ -0,0 +1,158 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "connection.hpp"
+#include "types.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace ldapxx {
+
+/// Options for a group_expander.
+struct group_expander_options {
+	/// The base DN to search for groups.
+	std::string base;
+
+	/// The attribute of a group that holds the DNs of its members.
+	std::string member_attribute = "member";
+
+	/// An extra filter that all groups must match, or empty to accept any entry with a matching member attribute.
+	std::string group_filter;
+
+	/// How long the direct groups of an entry are remembered.
+	std::chrono::milliseconds ttl{std::chrono::minutes{5}};
+
+	/// Maximum number of entries for which the direct groups are remembered.
+	std::size_t max_cache_size = 100000;
+
+	/// Maximum number of lookups in flight at the same time.
+	std::size_t max_in_flight = 64;
+
+	/// Maximum nesting depth to follow.
+	std::size_t max_depth = 32;
+};
+
+/// Statistics of a group_expander.
+struct group_expander_stats {
+	std::size_t lookups     = 0; ///< Lookups sent to the server.
+	std::size_t cache_hits  = 0; ///< Lookups answered from the cache.
+	std::size_t round_trips = 0; ///< Levels that needed at least one lookup from the server.
+	std::size_t cycles      = 0; ///< Groups reached again while expanding, indicating a cycle or diamond.
+};
+
+/// Resolve the groups an entry is a member of, directly or through nested groups.
+/**
+ * Groups are expanded breadth-first.
+ * The lookups for all entries of a level are sent to the server at once, pipelined on the connection,
+ * so each level of nesting costs a single round-trip instead of one per group.
+ *
+ * The direct groups of every entry are remembered for a configurable time,
+ * so expanding many users in the same groups only looks up the shared groups once.
+ * Groups that are reached more than once, for example because of a membership cycle, are expanded only once.
+ *
+ * A group_expander is not thread-safe, just like the connection it uses.
+ */
+class group_expander {
+	using clock = std::chrono::steady_clock;
+
+	struct cache_entry {
+		std::vector<std::string> groups;
+		clock::time_point expires;
+
+		/// Position of the key in the expiry list.
+		std::list<std::string const *>::iterator expiry;
+	};
+
+	ldapxx::connection connection_;
+	group_expander_options options_;
+	std::unordered_map<std::string, cache_entry> cache_;
+
+	/// Keys of the cache, ordered by expiry time, soonest first.
+	/**
+	 * All entries live for the same TTL, so appending refreshed entries keeps the list sorted.
+	 */
+	std::list<std::string const *> expiry_;
+
+	group_expander_stats stats_;
+
+	/// Look up the direct groups of a list of entries.
+	/**
+	 * The groups of entry i are stored in output[i].
+	 */
+	void direct_groups_(std::vector<std::string> const & dns, std::vector<std::vector<std::string>> & output, operation_limits const & limits, std::error_code & error);
+
+	/// Remove a cache entry.
+	void forget_(std::unordered_map<std::string, cache_entry>::iterator entry);
+
+	/// Remember the direct groups of an entry.
+	/**
+	 * An existing entry for the same key is overwritten.
+	 * If the cache is full, the entries closest to expiring are evicted first.
+	 */
+	void remember_(std::string key, std::vector<std::string> groups, clock::time_point now);
+
+public:
+	/// Create a group expander.
+	group_expander(ldapxx::connection connection, group_expander_options options);
+
+	/// The expiry list points into the cache, so the cache can be moved but not copied.
+	group_expander(group_expander const &) = delete;
+	group_expander & operator=(group_expander const &) = delete;
+	group_expander(group_expander &&) = default;
+	group_expander & operator=(group_expander &&) = default;
+
+	/// Get the statistics of the expander.
+	group_expander_stats const & stats() const { return stats_; }
+
+	/// Get all groups an entry is a member of, directly or indirectly.
+	/**
+	 * The groups are ordered by nesting level: direct groups first.
+	 */
+	std::vector<std::string> effective_groups(std::string const & dn, operation_limits const & limits);
+
+	/// Get all groups an entry is a member of, reporting errors through an error code.
+	std::vector<std::string> effective_groups(std::string const & dn, operation_limits const & limits, std::error_code & error);
+
+	/// Forget the cached groups of an entry, for example after changing its memberships.
+	void invalidate(std::string_view dn);
+
+	/// Forget all cached groups.
+	void clear() {
+		cache_.clear();
+		expiry_.clear();
+	}
+};
+
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "connection_pool.hpp"
+#include "latency_histogram.hpp"
+#include "types.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <vector>
+
+namespace ldapxx {
+
+/// Options for hedged searches.
+struct hedging_options {
+	/// The latency percentile after which a search is sent to a second replica.
+	double percentile = 0.95;
+
+	/// The hedge delay to use until enough latencies have been recorded.
+	std::chrono::milliseconds initial_delay{50};
+
+	/// Lower bound for the hedge delay, to avoid doubling the load when all replicas are fast.
+	std::chrono::milliseconds min_delay{2};
+
+	/// Upper bound for the hedge delay.
+	std::chrono::milliseconds max_delay{1000};
+
+	/// The number of recorded latencies needed before the percentile is used.
+	std::uint64_t min_samples = 100;
+};
+
+/// Statistics of a hedged searcher.
+struct hedging_stats {
+	std::uint64_t searches = 0; ///< The number of searches performed.
+	std::uint64_t hedged   = 0; ///< The number of searches that were sent to a second replica.
+	std::uint64_t won      = 0; ///< The number of hedged searches where the second replica answered first.
+};
+
+/// Search a set of replicas, sending a second request if the first replica is slow.
+/**
+ * Each search is sent to one replica, chosen round-robin.
+ * If no response arrived after the hedge delay, the search is also sent to the next replica,
+ * unless the pool of that replica has no connection available without waiting.
+ * The first response is used, and the other request is abandoned.
+ *
+ * The hedge delay is a percentile of the recently observed latencies,
+ * so only the slowest few percent of searches cause extra load.
+ *
+ * The pools must outlive the searcher. All member functions are thread-safe.
+ */
+class hedged_searcher {
+	std::vector<connection_pool *> replicas_;
+	hedging_options options_;
+	latency_histogram latency_;
+	std::atomic<std::size_t> next_{0};
+
+	std::atomic<std::uint64_t> searches_{0};
+	std::atomic<std::uint64_t> hedged_{0};
+	std::atomic<std::uint64_t> won_{0};
+
+public:
+	/// Create a hedged searcher for a set of replica pools.
+	hedged_searcher(std::vector<connection_pool *> replicas, hedging_options options = {});
+
+	/// Get the current hedge delay.
+	std::chrono::milliseconds hedge_delay() const;
+
+	/// Get the statistics of the searcher.
+	hedging_stats stats() const;
+
+	/// Perform a hedged search.
+	owned_result search(
+		query const & query,
+		operation_limits const & limits,
+		std::size_t max_response_size = default_max_response_size
+	);
+
+	/// Perform a hedged search, reporting errors through an error code.
+	owned_result search(
+		query const & query,
+		operation_limits const & limits,
+		std::size_t max_response_size,
+		std::error_code & error
+	);
+};
+
+}
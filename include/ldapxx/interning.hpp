@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "types.hpp"
+#include "detail/name_index.hpp"
+
+#include <ldap.h>
+
+#include <boost/optional.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ldapxx {
+
+/// Maps attribute names to small integer IDs, case insensitively.
+/**
+ * IDs are handed out densely, starting at zero, in order of first appearance.
+ * The spelling of the first appearance is kept as the canonical name.
+ * Attribute options are part of the name, so "cn" and "cn;lang-nl" get different IDs.
+ *
+ * Not thread-safe.
+ */
+class attribute_interner {
+	name_index index_;
+	std::vector<std::string> names_;
+
+public:
+	static constexpr std::uint32_t no_id = name_index::no_id;
+
+	/// Get the ID of a name, assigning a new ID if the name was not seen before.
+	std::uint32_t intern(std::string_view name);
+
+	/// Get the ID of a name without assigning a new one.
+	boost::optional<std::uint32_t> find(std::string_view name) const;
+
+	/// Get the canonical name for an ID.
+	std::string const & name(std::uint32_t id) const { return names_[id]; }
+
+	/// Get the number of interned names.
+	std::size_t size() const { return names_.size(); }
+};
+
+/// Options for a value_pool.
+struct value_pool_options {
+	/// Share the storage of identical values.
+	/**
+	 * If false, the pool is only used as arena for the values.
+	 */
+	bool deduplicate = true;
+
+	/// Values larger than this are never deduplicated.
+	/**
+	 * Large values such as photos and certificates are rarely shared,
+	 * so hashing them would only cost time.
+	 */
+	std::size_t max_deduplicated_size = 256;
+};
+
+/// Storage for attribute values that keeps one copy of identical values.
+/**
+ * Values are copied into large blocks, so storing a value rarely needs an allocation.
+ * The returned views stay valid until the pool is cleared or destroyed.
+ *
+ * Not thread-safe.
+ */
+class value_pool {
+	value_pool_options options_;
+
+	std::vector<std::unique_ptr<char[]>> blocks_;
+	char * block_       = nullptr;
+	std::size_t used_   = 0;
+	std::size_t free_   = 0;
+	std::size_t bytes_  = 0;
+
+	/// Open addressing hash table of deduplicated values.
+	std::vector<std::string_view> slots_;
+	std::size_t unique_ = 0;
+	std::size_t hits_   = 0;
+
+	/// Copy a value into the arena.
+	std::string_view store_(std::string_view value);
+
+	/// Double the number of slots.
+	void grow_();
+
+public:
+	explicit value_pool(value_pool_options options = {}) : options_{options} {}
+
+	value_pool(value_pool const &) = delete;
+	value_pool & operator=(value_pool const &) = delete;
+
+	/// Store a value, returning a view of the shared copy.
+	std::string_view intern(std::string_view value);
+
+	/// Get the number of bytes of value data held by the pool.
+	std::size_t bytes() const { return bytes_; }
+
+	/// Get the number of distinct deduplicated values.
+	std::size_t unique_values() const { return unique_; }
+
+	/// Get the number of values that were served from an existing copy.
+	std::size_t hits() const { return hits_; }
+
+	/// Release all values, invalidating all views handed out by the pool.
+	void clear();
+};
+
+/// An attribute value of an entry, with an interned attribute name.
+using interned_value = std::pair<std::uint32_t, std::string_view>;
+
+/// Collect the interned IDs of all attributes of an entry, adding them to a container using push_back().
+void collect_attributes(std::vector<std::uint32_t> & output, attribute_interner & names, LDAP * connection, entry_t entry);
+
+/// Collect the interned IDs of all attributes of an entry, returning them in a vector.
+std::vector<std::uint32_t> collect_attribute_ids(attribute_interner & names, LDAP * connection, entry_t entry);
+
+/// Convert an entry to a list of (attribute ID, value) pairs.
+/**
+ * This is the interned equivalent of entry_to_map():
+ * the pairs are sorted by attribute ID, and values of one attribute keep the order of the server.
+ * Attributes without values are skipped.
+ *
+ * The values are stored in the pool, so the pool must outlive the result.
+ */
+std::vector<interned_value> entry_to_interned(attribute_interner & names, value_pool & values, LDAP * connection, entry_t entry);
+
+}
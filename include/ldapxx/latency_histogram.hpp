@@ -0,0 +1,74 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace ldapxx {
+
+/// A lock-free histogram of operation latencies.
+/**
+ * Latencies are counted in logarithmic buckets, four per power of two microseconds,
+ * so percentiles are accurate to within about 20% over a range from microseconds to hours.
+ *
+ * When the number of samples reaches the window size, all counts are halved,
+ * so that old samples gradually lose their influence.
+ */
+class latency_histogram {
+public:
+	static constexpr std::size_t bucket_count = 160;
+
+private:
+	std::array<std::atomic<std::uint64_t>, bucket_count> buckets_{};
+	std::atomic<std::uint64_t> total_{0};
+	std::uint64_t window_;
+
+	static std::size_t bucket_index_(std::chrono::microseconds latency);
+	static std::chrono::microseconds bucket_upper_bound_(std::size_t index);
+
+public:
+	/// Create an empty histogram.
+	explicit latency_histogram(std::uint64_t window = 10000) : window_{window} {}
+
+	/// Record a latency.
+	void record(std::chrono::microseconds latency);
+
+	/// Get the number of samples that currently count.
+	std::uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+
+	/// Get an approximation of a percentile of the recorded latencies.
+	/**
+	 * The fraction must be between 0 and 1, for example 0.99 for the 99th percentile.
+	 * Returns zero if nothing was recorded yet.
+	 */
+	std::chrono::microseconds percentile(double fraction) const;
+};
+
+}
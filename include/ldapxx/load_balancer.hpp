@@ -0,0 +1,227 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "concurrency_limiter.hpp"
+#include "connection_pool.hpp"
+#include "types.hpp"
+
+#include <boost/optional.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace ldapxx {
+
+/// Strategies for picking a server.
+enum class balancing_strategy {
+	least_outstanding, ///< Pick the server with the fewest requests in flight.
+	ewma,              ///< Pick the server with the lowest average latency, weighted by the requests in flight.
+};
+
+/// Options for a load balancer.
+struct load_balancer_options {
+	balancing_strategy strategy = balancing_strategy::ewma;
+
+	/// Maximum number of connections per server.
+	std::size_t pool_size = 8;
+
+	/// Weight of a new latency sample in the moving average, between 0 and 1.
+	double ewma_weight = 0.3;
+
+	/// How long a failing server is ejected the first time.
+	std::chrono::milliseconds initial_backoff{500};
+
+	/// Upper bound for the ejection time, which doubles with every consecutive failure.
+	std::chrono::milliseconds max_backoff{30000};
+
+	/// If set, the requests in flight to each server are limited adaptively.
+	/**
+	 * Servers that reached their limit are skipped.
+	 * If all servers reached their limit, requests are rejected with errc::busy without contacting any server.
+	 */
+	boost::optional<concurrency_limiter_options> concurrency = boost::none;
+};
+
+/// Health and load information of a server.
+struct server_status {
+	std::string uri;
+	std::size_t outstanding;               ///< Requests in flight.
+	double concurrency_limit;              ///< The current concurrency limit, or zero if not limited.
+	std::chrono::microseconds average;     ///< Moving average of the latency.
+	bool ejected;                          ///< True if the server is currently ejected.
+	unsigned int failures;                 ///< Consecutive failures.
+};
+
+/// Spread operations over a set of equivalent servers, and route around failing servers.
+/**
+ * Each server has its own connection pool.
+ * Servers that fail with errc::server_down, errc::connect_error, errc::busy or errc::unavailable are ejected,
+ * with an exponential backoff for consecutive failures.
+ * When the backoff expired, a single probe request is let through before the server is fully used again.
+ *
+ * If all servers are ejected, the server that was ejected first is used anyway,
+ * since failing fast would not help the caller.
+ *
+ * Optionally, the requests in flight to each server are limited by a concurrency_limiter,
+ * so that an overloaded server gets less traffic instead of the same amount of retries.
+ *
+ * All member functions are thread-safe.
+ */
+class load_balancer {
+	using clock = std::chrono::steady_clock;
+
+	struct server {
+		std::string uri;
+		std::unique_ptr<connection_pool> pool;
+		std::unique_ptr<concurrency_limiter> limiter;
+		std::size_t outstanding = 0;
+		double average_us       = 0;
+		bool has_average        = false;
+		unsigned int failures   = 0;
+		clock::time_point ejected_until;
+		bool probing            = false;
+	};
+
+	load_balancer_options options_;
+	std::mutex mutex_;
+	std::vector<server> servers_;
+	std::size_t next_ = 0;
+
+	/// Pick a server and count the request as outstanding.
+	/**
+	 * If a concurrency limit is configured, a permit is taken from the picked server.
+	 * Returns the number of servers if all servers reached their limit.
+	 */
+	std::size_t pick_(concurrency_limiter::permit & permit);
+
+	/// Record the outcome of a request.
+	/**
+	 * If record_latency is false, only the outstanding count and the health of the server are updated.
+	 */
+	void complete_(std::size_t index, clock::time_point started, std::error_code const & error, bool record_latency);
+
+public:
+	/// A connection leased from one of the servers.
+	/**
+	 * The outcome of the operation should be reported with complete(),
+	 * otherwise the operation is counted as a success without latency information.
+	 */
+	class lease {
+		friend class load_balancer;
+
+		load_balancer * balancer_ = nullptr;
+		std::size_t server_ = 0;
+		clock::time_point started_;
+		connection_pool::lease lease_;
+		concurrency_limiter::permit permit_;
+
+	public:
+		lease() = default;
+
+		lease(lease && other) :
+			balancer_{other.balancer_},
+			server_{other.server_},
+			started_{other.started_},
+			lease_{std::move(other.lease_)},
+			permit_{std::move(other.permit_)}
+		{
+			other.balancer_ = nullptr;
+		}
+
+		lease & operator=(lease && other) {
+			if (this == &other) return *this;
+			complete({});
+			balancer_ = other.balancer_;
+			server_   = other.server_;
+			started_  = other.started_;
+			lease_    = std::move(other.lease_);
+			permit_   = std::move(other.permit_);
+			other.balancer_ = nullptr;
+			return *this;
+		}
+		~lease() { complete({}); }
+
+		/// Check if the lease holds a connection.
+		explicit operator bool() const { return bool(lease_); }
+
+		/// Get the leased connection.
+		ldapxx::connection connection() const { return lease_.connection(); }
+
+		/// Get the index of the server the connection belongs to.
+		std::size_t server() const { return server_; }
+
+		/// Report the outcome of the operation and return the connection.
+		/**
+		 * The latency is measured from the moment the lease was acquired.
+		 */
+		void complete(std::error_code const & error);
+	};
+
+	/// Create a load balancer for a set of server URIs.
+	load_balancer(
+		std::vector<std::string> const & uris,
+		connection_options const & connection_options,
+		boost::optional<bind_credentials> service = boost::none,
+		load_balancer_options options = {}
+	);
+
+	/// Lease a connection to the best server, bound as the service identity.
+	/**
+	 * Throws if no connection could be opened or none became available in time.
+	 * A timeout of std::chrono::milliseconds::max() waits without limit.
+	 */
+	lease acquire(std::chrono::milliseconds timeout);
+
+	/// Lease a connection to the best server, reporting errors through an error code.
+	lease acquire(std::chrono::milliseconds timeout, std::error_code & error);
+
+	/// Perform a search on the best server.
+	owned_result search(
+		query const & query,
+		operation_limits const & limits,
+		std::size_t max_response_size = default_max_response_size
+	);
+
+	/// Perform a search on the best server, reporting errors through an error code.
+	owned_result search(
+		query const & query,
+		operation_limits const & limits,
+		std::size_t max_response_size,
+		std::error_code & error
+	);
+
+	/// Get the health and load information of all servers.
+	std::vector<server_status> status();
+};
+
+}
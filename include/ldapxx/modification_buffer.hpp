@@ -0,0 +1,120 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "types.hpp"
+#include "util.hpp"
+
+#include <ldap.h>
+
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+
+namespace ldapxx {
+
+/// A re-usable buffer to build the native modification array for write operations.
+/**
+ * Values are stored as views, so the memory they refer to must stay valid until the write operation is done.
+ * Attribute names are copied into the buffer, because the C API needs them null terminated.
+ *
+ * Clearing the buffer keeps the allocated memory.
+ * When a buffer is re-used for many write operations,
+ * no allocations are needed once it has grown large enough.
+ */
+class modification_buffer {
+	struct entry {
+		int operation;
+		std::size_t attribute;
+		std::size_t values_begin;
+		std::size_t values_end;
+	};
+
+	std::vector<char> attributes_;
+	std::vector<berval> values_;
+	std::vector<entry> entries_;
+
+	std::vector<berval *> value_ptrs_;
+	std::vector<LDAPMod> mods_;
+	std::vector<LDAPMod *> mod_ptrs_;
+
+	void add_entry_(modification_type type, std::string_view attribute);
+
+public:
+	/// Remove all modifications from the buffer, but keep the allocated memory.
+	void clear();
+
+	/// Check if the buffer contains no modifications.
+	bool empty() const { return entries_.empty(); }
+
+	/// Get the number of modifications in the buffer.
+	std::size_t size() const { return entries_.size(); }
+
+	/// Get the total number of values in all modifications in the buffer.
+	std::size_t value_count() const { return values_.size(); }
+
+	/// Add a modification with a single value.
+	modification_buffer & add(modification_type type, std::string_view attribute, std::string_view value) {
+		return add(type, attribute, &value, &value + 1);
+	}
+
+	/// Add a modification with a list of values.
+	modification_buffer & add(modification_type type, std::string_view attribute, std::initializer_list<std::string_view> values) {
+		return add(type, attribute, values.begin(), values.end());
+	}
+
+	/// Add a modification with a range of values.
+	/**
+	 * The values must be convertible to std::string_view.
+	 * The values are ignored when removing a whole attribute.
+	 */
+	template<typename Iterator>
+	modification_buffer & add(modification_type type, std::string_view attribute, Iterator begin, Iterator end) {
+		add_entry_(type, attribute);
+		if (type == modification_type::remove_attribute) return *this;
+		for (; begin != end; ++begin) values_.push_back(to_berval(std::string_view{*begin}));
+		entries_.back().values_end = values_.size();
+		return *this;
+	}
+
+	/// Add a modification.
+	/**
+	 * The buffer refers to the values of the modification,
+	 * so the modification must stay valid until the write operation is done.
+	 */
+	modification_buffer & add(modification const & modification) {
+		return add(modification.type, modification.attribute, modification.values.begin(), modification.values.end());
+	}
+
+	/// Get the native null terminated array of LDAPMod pointers.
+	/**
+	 * The returned array is valid until the buffer is modified or destroyed.
+	 */
+	LDAPMod * * native();
+};
+
+}
@@ -161,4 +161,21 @@ void set_tls_protocol_min(LDAP * connection, tls_protocol_t minimum_version);
 std::string get_tls_random_file(LDAP * connection);
 void set_tls_random_file(LDAP * connection, std::string const & path);
 
+/// Create a new TLS context from the TLS options currently set on the connection.
+void set_tls_new_context(LDAP * connection);
+
+/// Get the TLS context of a connection.
+/**
+ * The library adds a reference to the returned context,
+ * and libldap has no public function to release it.
+ * See tls_context for a wrapper that takes care of that.
+ */
+void * get_tls_context(LDAP * connection);
+
+/// Make a connection use an existing TLS context.
+/**
+ * The library adds its own reference to the context.
+ */
+void set_tls_context(LDAP * connection, void * context);
+
 }
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "connection.hpp"
+#include "types.hpp"
+#include "util.hpp"
+
+#include <ldap.h>
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace ldapxx {
+
+/// Reader for the values of a huge multi-valued attribute in chunks.
+/**
+ * The values are retrieved with the `attribute;range=low-high` convention.
+ * Each chunk is a separate search request, and only one chunk is kept in memory at a time.
+ *
+ * If the server does not support ranged retrieval,
+ * all values are returned in the first chunk and the reader is done after that.
+ */
+class ranged_value_reader {
+	ldapxx::connection connection_;
+	std::string dn_;
+	std::string attribute_;
+	std::chrono::milliseconds timeout_;
+	std::size_t chunk_size_;
+	std::size_t next_ = 0;
+	bool done_        = false;
+	bool ranged_      = true;
+
+	/// Fetch the next chunk.
+	/**
+	 * The returned values must be freed with ldap_value_free_len().
+	 * Returns nullptr if the entry has no (more) values.
+	 */
+	berval * * fetch_chunk_();
+
+public:
+	/// Create a reader for an attribute of an entry.
+	/**
+	 * If chunk_size is zero, the server decides the size of each chunk.
+	 * Otherwise the given chunk size is requested explicitly.
+	 */
+	ranged_value_reader(
+		ldapxx::connection connection,
+		std::string dn,
+		std::string attribute,
+		std::chrono::milliseconds timeout,
+		std::size_t chunk_size = 0
+	);
+
+	/// Check if all values have been read.
+	bool done() const { return done_; }
+
+	/// Fetch the next chunk of values and invoke a callback for each value.
+	/**
+	 * The callback receives each value as std::string_view,
+	 * which is only valid during the callback.
+	 *
+	 * \return The number of values in the chunk.
+	 */
+	template<typename F>
+	std::size_t next(F && f) {
+		berval * * values = fetch_chunk_();
+		if (!values) return 0;
+		auto free_values = at_scope_exit([values] () { ldap_value_free_len(values); });
+
+		int count = ldap_count_values_len(values);
+		for (int i = 0; i < count; ++i) {
+			f(std::string_view{values[i]->bv_val, values[i]->bv_len});
+		}
+		return count;
+	}
+};
+
+/// Walk all values of a huge multi-valued attribute and invoke a callback for each value.
+/**
+ * The values are retrieved in chunks using a ranged_value_reader,
+ * so that memory use is bounded by the chunk size instead of the number of values.
+ *
+ * The callback receives each value as std::string_view,
+ * which is only valid during the callback.
+ */
+template<typename F>
+void walk_values_ranged(
+	ldapxx::connection connection,
+	std::string dn,
+	std::string attribute,
+	std::chrono::milliseconds timeout,
+	F && f,
+	std::size_t chunk_size = 0
+) {
+	ranged_value_reader reader{connection, std::move(dn), std::move(attribute), timeout, chunk_size};
+	while (!reader.done()) reader.next(f);
+}
+
+}
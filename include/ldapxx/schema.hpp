@@ -0,0 +1,196 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "connection.hpp"
+#include "detail/name_index.hpp"
+
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace ldapxx {
+
+/// How values of an attribute are compared for equality.
+enum class value_matching {
+	octet,              ///< Byte for byte, and the fallback for unknown matching rules.
+	case_exact,         ///< Case sensitive, ignoring insignificant spaces.
+	case_ignore,        ///< Case insensitive, ignoring insignificant spaces.
+	numeric_string,     ///< Ignoring all spaces.
+	telephone_number,   ///< Case insensitive, ignoring all spaces and hyphens.
+	distinguished_name, ///< As distinguished names, see normalize_dn().
+	generalized_time,   ///< As points in time, regardless of time zone and fraction notation.
+};
+
+/// An attribute type from the server schema.
+struct attribute_type {
+	std::string oid;
+	std::vector<std::string> names;
+	std::string superior;
+
+	/// Syntax OID, inherited from the superior type if not set directly.
+	std::string syntax;
+
+	/// Matching rules, inherited from the superior type if not set directly.
+	std::string equality;
+	std::string ordering;
+	std::string substring;
+
+	/// How values are compared, derived from the equality matching rule.
+	value_matching matching = value_matching::octet;
+
+	/// Values are binary data rather than text, derived from the syntax.
+	bool binary = false;
+
+	bool single_value         = false;
+	bool no_user_modification = false;
+
+	/// The attribute is an operational attribute.
+	bool operational = false;
+
+	/// Get the primary name of the attribute, or the OID if it has no name.
+	std::string const & name() const { return names.empty() ? oid : names.front(); }
+};
+
+/// A matching rule from the server schema.
+struct matching_rule {
+	std::string oid;
+	std::vector<std::string> names;
+	std::string syntax;
+};
+
+/// The attribute types and matching rules of a server schema.
+/**
+ * Attributes can be looked up by any of their names or by OID, case insensitively.
+ * Attribute options such as ";binary" or ";lang-nl" are ignored for lookups.
+ *
+ * Every attribute type has a dense numeric ID, which can be used to index application tables.
+ *
+ * A schema is immutable once constructed, so a single instance can be shared by any number of connections and threads.
+ */
+class schema {
+	std::vector<attribute_type> attributes_;
+	std::vector<matching_rule> matching_rules_;
+	name_index attribute_index_;
+	name_index matching_rule_index_;
+
+public:
+	/// Create a schema from parsed attribute types and matching rules.
+	/**
+	 * Inherited syntaxes and matching rules are resolved,
+	 * and the matching and binary fields of all attribute types are derived from them.
+	 */
+	schema(std::vector<attribute_type> attributes, std::vector<matching_rule> matching_rules);
+
+	/// Get all attribute types, indexed by ID.
+	std::vector<attribute_type> const & attributes() const { return attributes_; }
+
+	/// Get all matching rules.
+	std::vector<matching_rule> const & matching_rules() const { return matching_rules_; }
+
+	/// Get the ID of an attribute type by name or OID.
+	boost::optional<std::uint32_t> attribute_id(std::string_view name) const;
+
+	/// Get an attribute type by ID.
+	attribute_type const & attribute(std::uint32_t id) const { return attributes_[id]; }
+
+	/// Find an attribute type by name or OID.
+	/**
+	 * \return A null pointer if the attribute type is unknown.
+	 */
+	attribute_type const * find(std::string_view name) const;
+
+	/// Find a matching rule by name or OID.
+	/**
+	 * \return A null pointer if the matching rule is unknown.
+	 */
+	matching_rule const * find_matching_rule(std::string_view name) const;
+
+	/// Check if values of an attribute are binary data.
+	/**
+	 * Attributes with the ";binary" option are always binary.
+	 * Unknown attributes are assumed to be text.
+	 */
+	bool is_binary(std::string_view attribute) const;
+
+	/// Get a key for a value that is equal for all values that match according to the equality rule of the attribute.
+	/**
+	 * The key is suitable for client side comparisons, hashing and cache keys.
+	 * Values of unknown attributes are compared byte for byte.
+	 *
+	 * Case insensitive matching only folds ASCII characters.
+	 *
+	 * \return A view into either the value itself or the buffer.
+	 */
+	std::string_view equality_key(std::string_view attribute, std::string_view value, std::string & buffer) const;
+
+	/// Check if two values of an attribute match according to the equality rule of the attribute.
+	bool values_equal(std::string_view attribute, std::string_view a, std::string_view b) const;
+};
+
+/// Load the schema from the subschema subentry advertised by the root DSE.
+/**
+ * Attribute types that can not be parsed are skipped.
+ */
+std::shared_ptr<schema const> load_schema(connection & connection, operation_limits const & limits);
+
+/// Load the schema from the server, reporting errors through an error code.
+std::shared_ptr<schema const> load_schema(connection & connection, operation_limits const & limits, std::error_code & error);
+
+/// A schema that is loaded once and shared by all connections to the same directory.
+/**
+ * Thread-safe.
+ */
+class schema_cache {
+	std::mutex mutex_;
+	std::shared_ptr<schema const> schema_;
+
+public:
+	/// Get the schema, loading it with the given connection if it is not loaded yet.
+	std::shared_ptr<schema const> get(connection & connection, operation_limits const & limits);
+
+	/// Get the schema, reporting errors through an error code.
+	std::shared_ptr<schema const> get(connection & connection, operation_limits const & limits, std::error_code & error);
+
+	/// Get the schema if it is loaded, without contacting the server.
+	std::shared_ptr<schema const> cached();
+
+	/// Forget the loaded schema, so it is loaded again on the next call to get().
+	/**
+	 * Schemas that were handed out remain valid.
+	 */
+	void invalidate();
+};
+
+}
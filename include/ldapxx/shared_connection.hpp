@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "connection.hpp"
+#include "modification_buffer.hpp"
+#include "types.hpp"
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace ldapxx {
+
+/// A connection that can be used by many threads at the same time.
+/**
+ * Requests from all threads are sent over the same socket, one at a time.
+ * A dedicated reader thread reads the responses and hands each one to the thread waiting for it,
+ * so many threads can have requests in flight on a single connection.
+ *
+ * All requests share the identity the connection was bound as when it was handed to the shared_connection.
+ * Binding is not supported afterwards, since that would change the identity for all threads.
+ *
+ * If the connection breaks, all waiting requests and all later requests fail with the error that broke it.
+ *
+ * Parsing a result with the C API can update the state of the native handle,
+ * so results should be parsed inside with_lock(), unless noted otherwise.
+ */
+class shared_connection {
+	owned_connection connection_;
+
+	/// Protects all calls into the LDAP library, and the bookkeeping below.
+	std::mutex mutex_;
+	std::unordered_map<int, std::promise<owned_result>> pending_;
+	std::error_code broken_;
+
+	std::atomic<bool> stopping_{false};
+	int wake_up_[2] = {-1, -1};
+	std::thread reader_;
+
+	/// Read and dispatch responses until stopped or the connection breaks.
+	void read_loop_();
+
+	/// Fail all pending requests. The mutex must be held.
+	void fail_pending_(std::error_code const & error);
+
+public:
+	/// Share an open connection.
+	/**
+	 * The connection must already be opened, for example with connect(),
+	 * and be bound as the identity to use for all requests.
+	 */
+	explicit shared_connection(owned_connection connection);
+
+	shared_connection(shared_connection const &) = delete;
+	shared_connection & operator=(shared_connection const &) = delete;
+
+	/// Stop the reader thread and close the connection.
+	/**
+	 * Requests still waiting for a response fail with errc::server_down.
+	 * No thread may be using the connection anymore.
+	 */
+	~shared_connection();
+
+	/// Check if the connection is broken.
+	bool broken();
+
+	/// Call a function with exclusive access to the connection.
+	/**
+	 * Use this to parse results, or to call the C API directly.
+	 * The function must not wait for responses, since that would block the reader.
+	 */
+	template<typename F>
+	auto with_lock(F && f) {
+		std::lock_guard<std::mutex> lock{mutex_};
+		return std::forward<F>(f)(ldapxx::connection{connection_.get()});
+	}
+
+	/// Get the result code of a result, with exclusive access to the connection.
+	errc result_code(result_t result, std::error_code & error);
+
+	/// Send a request and wait for the complete response.
+	/**
+	 * The send function is called with exclusive access to the connection.
+	 * It must start an asynchronous operation and return its message ID.
+	 *
+	 * If the deadline passes or the operation is cancelled, the request is abandoned.
+	 */
+	owned_result execute(
+		std::function<int (ldapxx::connection connection, std::error_code & error)> const & send,
+		operation_limits const & limits,
+		std::error_code & error
+	);
+
+	/// Perform a search query.
+	owned_result search(query const & query, operation_limits const & limits, std::size_t max_response_size = default_max_response_size);
+
+	/// Perform a search query, reporting errors through an error code.
+	owned_result search(query const & query, operation_limits const & limits, std::size_t max_response_size, std::error_code & error);
+
+	/// Apply the modifications from a modification buffer to an LDAP entry.
+	void modify(std::string const & dn, modification_buffer & modifications, operation_limits const & limits);
+
+	/// Apply the modifications from a modification buffer to an LDAP entry, reporting errors through an error code.
+	void modify(std::string const & dn, modification_buffer & modifications, operation_limits const & limits, std::error_code & error);
+
+	/// Add an entry with the attributes from a modification buffer.
+	void add_entry(std::string const & dn, modification_buffer & attributes, operation_limits const & limits);
+
+	/// Add an entry with the attributes from a modification buffer, reporting errors through an error code.
+	void add_entry(std::string const & dn, modification_buffer & attributes, operation_limits const & limits, std::error_code & error);
+
+	/// Delete an entry.
+	void remove_entry(std::string const & dn, operation_limits const & limits);
+
+	/// Delete an entry, reporting errors through an error code.
+	void remove_entry(std::string const & dn, operation_limits const & limits, std::error_code & error);
+
+	/// Compare an attribute value of an entry with a given value.
+	bool compare(std::string const & dn, std::string const & attribute, std::string_view value, operation_limits const & limits);
+
+	/// Compare an attribute value of an entry with a given value, reporting errors through an error code.
+	bool compare(std::string const & dn, std::string const & attribute, std::string_view value, operation_limits const & limits, std::error_code & error);
+};
+
+}
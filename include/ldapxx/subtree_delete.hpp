@@ -0,0 +1,74 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "connection.hpp"
+
+#include <cstddef>
+#include <string>
+#include <system_error>
+
+namespace ldapxx {
+
+/// Options for remove_subtree().
+struct subtree_delete_options {
+	/// Use the tree delete control if the server advertises it in the root DSE.
+	bool use_tree_delete = true;
+
+	/// Maximum number of delete requests in flight when deleting entry by entry.
+	std::size_t window = 64;
+
+	/// Number of entries per page when enumerating the subtree to delete it entry by entry.
+	/**
+	 * Keep this within the size limit of the server.
+	 */
+	std::size_t page_size = 500;
+};
+
+/// Delete an entry and all entries below it.
+/**
+ * If the server supports the tree delete control (1.2.840.113556.1.4.805),
+ * the whole subtree is deleted with a single request.
+ *
+ * Otherwise the subtree is enumerated with a paged search and deleted entry by entry, leaves first.
+ * Up to `window` delete requests are in flight at the same time.
+ * An entry is deleted as soon as all of its children are gone,
+ * so independent branches are deleted in parallel.
+ * Entries that were already deleted by someone else are skipped.
+ *
+ * Without the tree delete control, the deletion is not atomic:
+ * if an error occurs, part of the subtree may already be deleted.
+ * Calling remove_subtree() again continues with the remaining entries.
+ *
+ * The connection should not be used for other operations at the same time.
+ */
+void remove_subtree(connection & connection, std::string const & dn, operation_limits const & limits, subtree_delete_options const & options = {});
+
+/// Delete an entry and all entries below it, reporting errors through an error code.
+void remove_subtree(connection & connection, std::string const & dn, operation_limits const & limits, subtree_delete_options const & options, std::error_code & error);
+
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "connection.hpp"
+#include "types.hpp"
+
+#include <ldap.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ldapxx {
+
+/// The mode of a content synchronization search.
+enum class sync_mode {
+	refresh_only        = LDAP_SYNC_REFRESH_ONLY,        ///< Synchronize once and finish.
+	refresh_and_persist = LDAP_SYNC_REFRESH_AND_PERSIST, ///< Synchronize and keep receiving changes until stopped.
+};
+
+/// The state of an entry as reported by the server.
+enum class sync_state {
+	present = LDAP_SYNC_PRESENT, ///< The entry is unchanged. No attributes are sent.
+	add     = LDAP_SYNC_ADD,     ///< The entry was added, or is new to the consumer.
+	modify  = LDAP_SYNC_MODIFY,  ///< The entry was modified. All requested attributes are sent.
+	remove  = LDAP_SYNC_DELETE,  ///< The entry was deleted. No attributes are sent.
+};
+
+/// Callbacks for the events of a sync_consumer.
+/**
+ * Callbacks that are not set are not invoked.
+ * Views and handles passed to a callback are only valid during the callback.
+ */
+struct sync_callbacks {
+	/// A sync search was sent, and a new refresh stage starts.
+	std::function<void ()> refresh_started;
+
+	/// An entry was reported with its state and raw 16 byte entryUUID.
+	std::function<void (sync_state state, std::string_view uuid, LDAP * connection, entry_t entry)> entry;
+
+	/// A set of entries was reported by entryUUID only, either as deleted or as present.
+	std::function<void (std::vector<std::string_view> const & uuids, bool deleted)> uuids;
+
+	/// A present phase ended.
+	/**
+	 * Entries that were not reported since the start of the refresh no longer exist (or no longer match the query),
+	 * and should be removed.
+	 */
+	std::function<void ()> present_phase_done;
+
+	/// The refresh stage is complete, and the consumer is in sync with the server.
+	/**
+	 * In refresh_and_persist mode, changes are reported as they happen after this.
+	 */
+	std::function<void ()> refresh_done;
+
+	/// The synchronization cookie changed.
+	/**
+	 * Store the cookie to resume synchronization from this point later.
+	 */
+	std::function<void (std::string_view cookie)> cookie;
+};
+
+/// A consumer for the content synchronization operation (syncrepl) as specified by RFC 4533.
+/**
+ * The consumer sends a search with the sync request control and reports the responses to callbacks.
+ * The responses are only processed when poll() or run() is called.
+ *
+ * Starting with the cookie from a previous synchronization only transfers the changes since then.
+ * If the server can no longer resume from the cookie, the consumer restarts with a full refresh automatically.
+ *
+ * The connection should not be used for other operations while the consumer is active.
+ */
+class sync_consumer {
+	ldapxx::connection connection_;
+	ldapxx::query query_;
+	sync_mode mode_;
+	sync_callbacks callbacks_;
+	std::string cookie_;
+	int message_id_    = -1;
+	bool refresh_done_ = false;
+
+	void set_cookie_(berval const & cookie);
+	void finish_refresh_();
+	void handle_entry_(LDAPMessage * message, std::error_code & error);
+	void handle_intermediate_(LDAPMessage * message, std::error_code & error);
+	void handle_result_(LDAPMessage * message, std::error_code & error);
+
+public:
+	/// Create a consumer for a query.
+	/**
+	 * If a cookie is given, synchronization resumes from that point.
+	 */
+	sync_consumer(ldapxx::connection connection, ldapxx::query query, sync_mode mode, sync_callbacks callbacks, std::string cookie = {});
+
+	sync_consumer(sync_consumer const &) = delete;
+	sync_consumer & operator=(sync_consumer const &) = delete;
+
+	/// Abandon the sync search if it is still active.
+	~sync_consumer();
+
+	/// Get the latest synchronization cookie.
+	std::string const & cookie() const { return cookie_; }
+
+	/// Check if the sync search is active.
+	bool active() const { return message_id_ >= 0; }
+
+	/// Send the sync search to the server.
+	void start();
+
+	/// Send the sync search to the server, reporting errors through an error code.
+	void start(std::error_code & error);
+
+	/// Process responses, waiting at most the given time for the first one.
+	/**
+	 * All responses that are available are processed without waiting further.
+	 *
+	 * \return True if the sync search is still active, false if it finished.
+	 */
+	bool poll(std::chrono::milliseconds timeout);
+
+	/// Process responses, reporting errors through an error code.
+	bool poll(std::chrono::milliseconds timeout, std::error_code & error);
+
+	/// Process responses until the sync search finishes.
+	/**
+	 * In refresh_and_persist mode, the search only finishes when the server ends it,
+	 * so typically this runs until the limits are exceeded.
+	 * The sync search is abandoned if the deadline passes or the operation is cancelled.
+	 */
+	void run(operation_limits const & limits);
+
+	/// Process responses until the sync search finishes, reporting errors through an error code.
+	void run(operation_limits const & limits, std::error_code & error);
+
+	/// Abandon the sync search.
+	/**
+	 * The cookie remains valid, so a new consumer can resume from it later.
+	 */
+	void stop();
+};
+
+/// An in-memory replica of the entries matched by a sync_consumer.
+/**
+ * Use callbacks() to get callbacks for a sync_consumer that keep the store up to date.
+ * The store is not thread-safe: only access it from the thread that polls the consumer.
+ */
+class sync_store {
+public:
+	/// A replicated entry.
+	struct entry {
+		std::string dn;
+		std::map<std::string, std::vector<std::string>> attributes;
+	};
+
+private:
+	std::unordered_map<std::string, entry> entries_;
+	std::string cookie_;
+
+	/// Entries reported during the refresh stage, to find stale entries at the end of a present phase.
+	std::unordered_set<std::string> seen_;
+	bool tracking_ = true;
+
+	void update_(sync_state state, std::string_view uuid, LDAP * connection, entry_t entry);
+	void update_(std::vector<std::string_view> const & uuids, bool deleted);
+	void present_phase_done_();
+
+public:
+	/// Get callbacks that apply the events of a sync_consumer to the store.
+	/**
+	 * The store must outlive the consumer using the callbacks.
+	 */
+	sync_callbacks callbacks();
+
+	/// Get all entries, indexed by raw entryUUID.
+	std::unordered_map<std::string, entry> const & entries() const { return entries_; }
+
+	/// Find an entry by raw entryUUID.
+	/**
+	 * \return A pointer to the entry, or null if it is not in the store.
+	 */
+	entry const * find(std::string_view uuid) const;
+
+	/// Get the cookie of the last applied event.
+	std::string const & cookie() const { return cookie_; }
+
+	/// Remove all entries.
+	void clear();
+};
+
+/// Format a raw 16 byte entryUUID in the usual textual form.
+std::string format_uuid(std::string_view uuid);
+
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "connection.hpp"
+
+#include <memory>
+
+namespace ldapxx {
+
+/// A TLS context that can be shared by many connections.
+/**
+ * Normally, every connection builds its own TLS context when the TLS handshake is performed,
+ * which means certificates, keys and CRLs are loaded from disk again for every connection.
+ * A tls_context is built once, and can be attached to any number of connections
+ * through connection_options::tls_options::context.
+ *
+ * The native context is reference counted by the LDAP library,
+ * so it is safe to destroy the tls_context while connections still use it.
+ *
+ * libldap has no public function to release a reference to a context.
+ * If libldap uses OpenSSL and ldapxx is built with OpenSSL, the reference is released with SSL_CTX_free().
+ * Otherwise the private ldap_pvt_tls_ctx_free() is used if CMake found it in libldap.
+ * If neither is available, the reference of the tls_context is never released,
+ * so the context lives until the process exits.
+ */
+class tls_context {
+	void * native_;
+	bool openssl_ = false;
+
+public:
+	/// Build a TLS context from TLS options.
+	/**
+	 * The starttls flag and the context member of the options are ignored.
+	 */
+	explicit tls_context(connection_options::tls_options const & options);
+
+	tls_context(tls_context const &) = delete;
+	tls_context & operator=(tls_context const &) = delete;
+
+	/// Release the reference to the native context.
+	~tls_context();
+
+	/// Get the native TLS context.
+	void * native() const { return native_; }
+};
+
+/// Build a shared TLS context from TLS options.
+inline std::shared_ptr<tls_context const> make_tls_context(connection_options::tls_options const & options) {
+	return std::make_shared<tls_context const>(options);
+}
+
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <ldap.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace ldapxx {
+
+/// Statistics of a TLS session cache.
+struct tls_session_stats {
+	std::uint64_t handshakes = 0; ///< The number of completed TLS handshakes.
+	std::uint64_t resumed    = 0; ///< The number of handshakes that resumed a cached session.
+
+	/// Get the fraction of handshakes that resumed a cached session.
+	double hit_rate() const { return handshakes ? double(resumed) / double(handshakes) : 0.0; }
+};
+
+/// A cache of TLS sessions to resume when connecting to the same server again.
+/**
+ * Resuming a session results in an abbreviated TLS handshake,
+ * which saves round-trips and CPU time on both sides when connections are opened frequently.
+ * Both session IDs and session tickets are supported, including TLS 1.3 tickets.
+ *
+ * One session is kept per server URI, and it is replaced whenever the server issues a new one.
+ *
+ * Attach the cache to connections through connection_options::tls_options::session_cache.
+ * The cache must outlive all connections it is attached to.
+ *
+ * This requires ldapxx to be built with OpenSSL, and libldap to use OpenSSL as TLS library.
+ * Otherwise, the constructor throws an error with errc::not_supported.
+ */
+class tls_session_cache {
+	/// The cached state for a single server.
+	struct server {
+		tls_session_cache * cache;
+		void * session; ///< The native TLS session, or null.
+	};
+
+	std::mutex mutex_;
+	std::map<std::string, server> servers_;
+	std::atomic<std::uint64_t> handshakes_{0};
+	std::atomic<std::uint64_t> resumed_{0};
+
+	friend struct tls_session_callbacks;
+
+	/// Record the outcome of a TLS handshake.
+	void record_handshake_(bool resumed);
+
+	/// Replace the cached session of a server, taking ownership of the new session.
+	void store_(server & server, void * session);
+
+public:
+	/// Create an empty TLS session cache.
+	tls_session_cache();
+
+	tls_session_cache(tls_session_cache const &) = delete;
+	tls_session_cache & operator=(tls_session_cache const &) = delete;
+
+	/// Free all cached sessions.
+	~tls_session_cache();
+
+	/// Make a connection use the cache.
+	/**
+	 * Must be called after the URI and the TLS options of the connection are set, and before the TLS handshake.
+	 * The TLS context of the connection is created if it doesn't have one yet,
+	 * and configured to report new sessions to the cache.
+	 * A new session callback installed on the context by the application is still called.
+	 */
+	void attach(LDAP * connection);
+
+	/// Forget all cached sessions.
+	void clear();
+
+	/// Get the resumption statistics.
+	tls_session_stats stats() const;
+};
+
+}
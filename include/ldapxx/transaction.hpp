@@ -0,0 +1,117 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "connection.hpp"
+#include "modification_buffer.hpp"
+
+#include <ldap.h>
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ldapxx {
+
+/// An LDAP transaction as specified by RFC 5805.
+/**
+ * The constructor starts a transaction on the server.
+ * Write operations are sent immediately with the transaction specification control,
+ * without waiting for the server to acknowledge them.
+ * The server queues them until the transaction is committed or aborted.
+ *
+ * All queued operations are applied atomically by commit(),
+ * which needs only a single round-trip after the responses for the queued operations have arrived.
+ *
+ * If the transaction is destroyed without being committed or aborted, it is aborted.
+ *
+ * The connection should not be used for other operations while the transaction is in progress.
+ */
+class transaction {
+	ldapxx::connection connection_;
+	std::chrono::milliseconds timeout_;
+	std::string id_;
+	LDAPControl control_;
+	std::array<LDAPControl *, 2> controls_;
+	std::vector<int> pending_;
+	modification_buffer buffer_;
+	bool finished_ = false;
+
+	void check_active_() const;
+	void collect_pending_();
+	void end_(bool commit);
+
+public:
+	/// Start a transaction on a connection.
+	/**
+	 * The timeout is used for every round-trip done by the transaction.
+	 */
+	transaction(ldapxx::connection connection, std::chrono::milliseconds timeout);
+
+	transaction(transaction const &) = delete;
+	transaction & operator=(transaction const &) = delete;
+
+	/// Abort the transaction if it wasn't committed or aborted yet.
+	~transaction();
+
+	/// Get the transaction identifier assigned by the server.
+	std::string const & id() const { return id_; }
+
+	/// Queue modifications to an LDAP entry.
+	void modify(std::string const & dn, std::vector<modification> const & modifications);
+
+	/// Queue the modifications from a modification buffer to an LDAP entry.
+	/**
+	 * The request is encoded immediately, so the buffer may be re-used afterwards.
+	 */
+	void modify(std::string const & dn, modification_buffer & modifications);
+
+	/// Queue adding an entry to the LDAP directory.
+	void add_entry(std::string const & dn, std::map<std::string, std::vector<std::string>> const & attributes);
+
+	/// Queue adding an entry to the LDAP directory with the attributes from a modification buffer.
+	/**
+	 * The request is encoded immediately, so the buffer may be re-used afterwards.
+	 */
+	void add_entry(std::string const & dn, modification_buffer & attributes);
+
+	/// Queue deleting an entry from the LDAP directory.
+	void remove_entry(std::string const & dn);
+
+	/// Commit the transaction.
+	/**
+	 * If the server refuses to commit, an error is thrown and no changes are applied.
+	 * If a queued operation failed, the transaction is aborted and the error of the operation is thrown.
+	 */
+	void commit();
+
+	/// Abort the transaction, discarding all queued operations.
+	void abort();
+};
+
+}
@@ -77,6 +77,11 @@ namespace impl {
 	struct msg_deleter {
 		void operator() (LDAPMessage * msg) { ldap_msgfree(msg); }
 	};
+
+	/// Close an LDAP connection by calling ldap_unbind_ext_s().
+	struct ldap_deleter {
+		void operator() (LDAP * ldap) { ldap_unbind_ext_s(ldap, nullptr, nullptr); }
+	};
 }
 
 /// An owned LDAP query result.
@@ -88,6 +93,15 @@ struct owned_result : public std::unique_ptr<LDAPMessage, impl::msg_deleter> {
 	operator result_t() { return result_t{get()}; }
 };
 
+/// An owned LDAP connection.
+/**
+ * The connection is automatically closed when it goes out of scope.
+ */
+struct owned_connection : public std::unique_ptr<LDAP, impl::ldap_deleter> {
+	using std::unique_ptr<LDAP, impl::ldap_deleter>::unique_ptr;
+	operator LDAP * () const { return get(); }
+};
+
 /// A qeury scope.
 enum class scope {
 	base      = LDAP_SCOPE_BASE,     ///< Search only the base DN.
@@ -96,6 +110,13 @@ enum class scope {
 	children  = LDAP_SCOPE_CHILDREN, ///< Search all the descendants of the base DN (but not the base DN itself).
 };
 
+/// A key for sorting search results on the server, as specified by RFC 2891.
+struct sort_key {
+	std::string attribute;
+	std::string ordering_rule; ///< The ordering rule to use, or empty for the default ordering of the attribute.
+	bool reverse = false;
+};
+
 /// An LDAP search query.
 struct query {
 	std::string base;
@@ -103,6 +124,9 @@ struct query {
 	std::string filter                  = "(objectClass=*)";
 	std::vector<std::string> attributes = {"*"};
 	bool attributes_only                = false;
+
+	/// If not empty, the server must sort the results by these keys, or fail the search.
+	std::vector<sort_key> sort;
 };
 
 /// Helper class to construct a query in pieces.
@@ -129,6 +153,9 @@ struct query_constructor {
 	query_constructor  & attributes_only(bool attributes_only)  & { query.attributes_only = attributes_only; return *this; }
 	query_constructor && attributes_only(bool attributes_only) && { query.attributes_only = attributes_only; return std::move(*this); }
 
+	query_constructor  & sort(std::vector<sort_key> sort)  & { query.sort = std::move(sort); return *this; }
+	query_constructor && sort(std::vector<sort_key> sort) && { query.sort = std::move(sort); return std::move(*this); }
+
 	/// Allow implicit conversion to a query.
 	operator ldapxx::query       & ()       & { return query; }
 	operator ldapxx::query const & () const & { return query; }
@@ -153,4 +180,11 @@ struct modification {
 	std::vector<std::string> values; ///< The new values (not used if the whole attribute is deleted).
 };
 
+/// An attribute value assertion to compare against an entry.
+struct compare_request {
+	std::string dn;        ///< The DN of the entry to compare against.
+	std::string attribute; ///< The attribute to compare.
+	std::string value;     ///< The value to compare with.
+};
+
 }
@@ -27,7 +27,11 @@
 #pragma once
 #include <lber.h>
 
+#include <boost/optional.hpp>
+
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -84,6 +88,26 @@ scope_guard<F> at_scope_exit(F && callback) {
 	return scope_guard<F>(std::forward<F>(callback));
 }
 
+/// Convert an ASCII letter to lowercase, leaving other characters alone.
+inline char ascii_lower(char c) {
+	return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+/// Compare two strings, ignoring the case of ASCII letters.
+inline bool iequals(std::string_view a, std::string_view b) {
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [] (char x, char y) { return ascii_lower(x) == ascii_lower(y); });
+}
+
+/// 32 bit FNV-1a hash of the lowercase form of a name, for use with iequals().
+inline std::uint32_t hash_name(std::string_view name) {
+	std::uint32_t hash = 0x811c9dc5u;
+	for (char c : name) {
+		hash ^= std::uint8_t(ascii_lower(c));
+		hash *= 0x01000193u;
+	}
+	return hash;
+}
+
 /// Convert microseconds to a timeval struct.
 inline timeval to_timeval(std::chrono::microseconds val) {
 	return {
@@ -142,4 +166,18 @@ std::vector<T *> toPtrs(std::vector<T> & values) {
 std::vector<char const *> to_cstr_array(std::vector<std::string_view> const & input);
 std::vector<char const *> to_cstr_array(std::vector<std::string>      const & input);
 
+/// Parse an LDAP generalized time value such as "20170102030405Z" or "20170102030405.123+0100".
+/**
+ * Fractions are kept up to nanoseconds.
+ *
+ * \return The point in time, or boost::none if the value could not be parsed.
+ */
+boost::optional<std::chrono::system_clock::time_point> parse_generalized_time(std::string_view value);
+
+/// Format a point in time as an LDAP generalized time value in UTC.
+/**
+ * The fraction of a second is only added if it is not zero, without trailing zeros.
+ */
+std::string format_generalized_time(std::chrono::system_clock::time_point time);
+
 }
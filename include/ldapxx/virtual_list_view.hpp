@@ -0,0 +1,94 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "cancellation.hpp"
+#include "connection.hpp"
+#include "types.hpp"
+
+#include <ldap.h>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace ldapxx {
+
+/// A window of a sorted search result.
+struct vlv_window {
+	/// The search result with the entries of the window.
+	owned_result result;
+
+	/// The zero-based position of the target entry in the sorted result, as reported by the server.
+	std::size_t target;
+
+	/// The server's estimate of the number of entries in the sorted result.
+	std::size_t content_count;
+};
+
+/// Access windows of a sorted search result with the virtual list view control.
+/**
+ * Only the entries of the requested window are sent by the server,
+ * so the cost of a window does not depend on the size of the full result.
+ *
+ * The query must have sort keys, since the virtual list view control requires server-side sorting.
+ * The context identifier returned by the server is sent with the next window,
+ * so the server can reuse the sorted result.
+ *
+ * See draft-ietf-ldapext-ldapv3-vlv.
+ */
+class virtual_list_view {
+	ldapxx::connection connection_;
+	ldapxx::query query_;
+	std::string context_;
+
+	vlv_window fetch_(LDAPVLVInfo & info, operation_limits const & limits, std::error_code & error);
+
+public:
+	/// Create a virtual list view for a query with sort keys.
+	virtual_list_view(ldapxx::connection connection, ldapxx::query query);
+
+	/// Get the context identifier of the last window, or an empty string.
+	std::string const & context() const { return context_; }
+
+	/// Fetch the entries at zero-based positions [first, first + count) of the sorted result.
+	vlv_window fetch(std::size_t first, std::size_t count, operation_limits const & limits);
+
+	/// Fetch the entries at zero-based positions [first, first + count) of the sorted result, reporting errors through an error code.
+	vlv_window fetch(std::size_t first, std::size_t count, operation_limits const & limits, std::error_code & error);
+
+	/// Fetch the entries around the first entry that sorts at or after a value of the first sort key.
+	/**
+	 * The window contains up to `before` entries before the target entry, the target entry, and up to `after` entries after it.
+	 */
+	vlv_window fetch_around(std::string_view value, std::size_t before, std::size_t after, operation_limits const & limits);
+
+	/// Fetch the entries around the first entry that sorts at or after a value, reporting errors through an error code.
+	vlv_window fetch_around(std::string_view value, std::size_t before, std::size_t after, operation_limits const & limits, std::error_code & error);
+};
+
+}
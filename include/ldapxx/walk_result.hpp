@@ -24,6 +24,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "error.hpp"
 #include "types.hpp"
 #include "util.hpp"
 
@@ -31,6 +32,7 @@
 
 #include <vector>
 #include <map>
+#include <system_error>
 
 namespace ldapxx {
 
@@ -102,6 +104,25 @@ namespace ldapxx {
 
 	/// Convert an entry to a key/value multimap.
 	std::multimap<std::string, std::string> entry_to_map(LDAP * connection, entry_t entry);
+
+	/// Get the result code from the final result message in a result.
+	/**
+	 * Search entries, references and intermediate responses are skipped.
+	 */
+	errc result_code(LDAP * connection, result_t result);
+
+	/// Get the result code from the final result message in a result, reporting errors through an error code.
+	/**
+	 * The error code is set if the result could not be parsed.
+	 * The returned result code itself may still indicate a failed operation.
+	 */
+	errc result_code(LDAP * connection, result_t result, std::error_code & error);
+
+	/// Find the final result message of a search result.
+	/**
+	 * \return The result message, or a null pointer if the result has none.
+	 */
+	LDAPMessage * find_search_result(LDAP * connection, LDAPMessage * result);
 }
 
 #include "detail/walk_result.hpp"
@@ -0,0 +1,245 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "authenticator.hpp"
+#include "detail/sha256.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <deque>
+#include <random>
+#include <utility>
+
+namespace ldapxx {
+
+namespace {
+	/// Generate a random salt for the credential cache.
+	std::string random_salt() {
+		std::random_device random;
+		std::string result(32, '\0');
+		for (char & c : result) c = char(random());
+		return result;
+	}
+
+	/// Check if an error leaves the connection in an unknown or broken state.
+	bool connection_broken(std::error_code const & error) {
+		if (error.category() != ldap_category()) return false;
+		errc code = errc(error.value());
+		return code == errc::server_down || code == errc::timeout || code == errc::connect_error;
+	}
+}
+
+authenticator::authenticator(
+	std::string uri,
+	connection_options const & connection_options,
+	std::size_t pool_size,
+	boost::optional<bind_credentials> service,
+	authenticator_options options
+) :
+	pool_{std::move(uri), connection_options, pool_size, std::move(service)},
+	options_{options},
+	salt_{random_salt()} {}
+
+std::string authenticator::cache_key_(std::string_view dn, std::string_view password) const {
+	// Include the length of the DN so that the split between DN and password is unambiguous.
+	std::string length = std::to_string(dn.size()) + ":";
+
+	sha256 hash;
+	hash.update(salt_);
+	hash.update(length);
+	hash.update(dn);
+	hash.update(password);
+	sha256::digest digest = hash.finish();
+	return std::string(digest.begin(), digest.end());
+}
+
+bool authenticator::cached_(std::string const & key) {
+	std::lock_guard<std::mutex> lock{cache_mutex_};
+	auto found = cache_.find(key);
+	if (found == cache_.end()) return false;
+	if (found->second > std::chrono::steady_clock::now()) return true;
+	cache_.erase(found);
+	return false;
+}
+
+void authenticator::remember_(std::string key) {
+	auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock{cache_mutex_};
+
+	if (cache_.size() >= options_.cache_size) {
+		for (auto i = cache_.begin(); i != cache_.end();) {
+			if (i->second <= now) i = cache_.erase(i);
+			else ++i;
+		}
+	}
+	if (cache_.size() >= options_.cache_size) return;
+	cache_[std::move(key)] = now + options_.cache_ttl;
+}
+
+void authenticator::clear_cache() {
+	std::lock_guard<std::mutex> lock{cache_mutex_};
+	cache_.clear();
+}
+
+int authenticator::send_bind_(connection_pool::lease & lease, std::string const & dn, std::string_view password, std::error_code & error) {
+	berval ber_password = to_berval(password);
+	int message_id = -1;
+	error = errc(ldap_sasl_bind(lease, dn.c_str(), LDAP_SASL_SIMPLE, &ber_password, nullptr, nullptr, &message_id));
+	if (error) lease.discard();
+	else lease.mark_rebound();
+	return message_id;
+}
+
+errc authenticator::bind_outcome_(connection_pool::lease & lease, int message_id, std::error_code & error) {
+	owned_result result = lease.connection().wait_result(message_id, options_.timeout, error);
+	if (error) {
+		// The bind may still be in progress, so the connection can't be used anymore.
+		lease.discard();
+		return errc::other;
+	}
+
+	errc code = result_code(lease, result, error);
+	if (error) {
+		if (connection_broken(error)) lease.discard();
+		return errc::other;
+	}
+
+	// A failed bind leaves the connection anonymous, but still usable.
+	if (connection_broken(code)) lease.discard();
+	return code;
+}
+
+bool authenticator::verify(std::string const & dn, std::string_view password) {
+	std::error_code error;
+	bool result = verify(dn, password, error);
+	if (error) throw ldapxx::error{errc(error.value()), "verifying credentials"};
+	return result;
+}
+
+bool authenticator::verify(std::string const & dn, std::string_view password, std::error_code & error) {
+	error = {};
+	if (password.empty()) return false;
+
+	bool use_cache = options_.cache_ttl.count() > 0;
+	std::string key;
+	if (use_cache) {
+		key = cache_key_(dn, password);
+		if (cached_(key)) return true;
+	}
+
+	connection_pool::lease lease = pool_.acquire_unbound(options_.timeout);
+	if (!lease) {
+		error = errc::timeout;
+		return false;
+	}
+
+	int message_id = send_bind_(lease, dn, password, error);
+	if (error) return false;
+	errc code = bind_outcome_(lease, message_id, error);
+	if (error) return false;
+	if (code == errc::invalid_credentials) return false;
+	if (code != errc::success) {
+		error = code;
+		return false;
+	}
+	if (use_cache) remember_(std::move(key));
+	return true;
+}
+
+std::vector<verification> authenticator::verify(std::vector<bind_credentials> const & credentials) {
+	std::error_code error;
+	std::vector<verification> result = verify(credentials, error);
+	if (error) throw ldapxx::error{errc(error.value()), "verifying credentials"};
+	return result;
+}
+
+std::vector<verification> authenticator::verify(std::vector<bind_credentials> const & credentials, std::error_code & error) {
+	error = {};
+	std::vector<verification> result(credentials.size());
+	bool use_cache = options_.cache_ttl.count() > 0;
+
+	// Resolve what we can without contacting the server.
+	std::vector<std::string> keys(use_cache ? credentials.size() : 0);
+	std::vector<std::size_t> pending;
+	for (std::size_t i = 0; i < credentials.size(); ++i) {
+		if (credentials[i].password.empty()) continue;
+		if (use_cache) {
+			keys[i] = cache_key_(credentials[i].dn, credentials[i].password);
+			if (cached_(keys[i])) {
+				result[i].valid = true;
+				continue;
+			}
+		}
+		pending.push_back(i);
+	}
+
+	struct attempt {
+		connection_pool::lease lease;
+		std::size_t index;
+		int message_id;
+	};
+
+	// Connections with a bind in flight are in an unknown state if we bail out.
+	std::deque<attempt> active;
+	auto discard_active = at_scope_exit([&] () {
+		for (attempt & attempt : active) attempt.lease.discard();
+	});
+
+	std::size_t next = 0;
+	while (next < pending.size() || !active.empty()) {
+		// Send as many binds as there are free connections, but always make progress.
+		while (next < pending.size()) {
+			connection_pool::lease lease = active.empty() ? pool_.acquire_unbound(options_.timeout) : pool_.try_acquire_unbound();
+			if (!lease && active.empty()) {
+				error = errc::timeout;
+				return {};
+			}
+			if (!lease) break;
+
+			bind_credentials const & current = credentials[pending[next]];
+			int message_id = send_bind_(lease, current.dn, current.password, error);
+			if (error) return {};
+			active.push_back({std::move(lease), pending[next], message_id});
+			++next;
+		}
+
+		// The binds were sent concurrently, so they complete in roughly the same order.
+		attempt & oldest = active.front();
+		errc code = bind_outcome_(oldest.lease, oldest.message_id, error);
+		if (error) return {};
+
+		// Other result codes are about these credentials only, such as a locked account.
+		verification & outcome = result[oldest.index];
+		outcome.valid = code == errc::success;
+		if (code != errc::success && code != errc::invalid_credentials) outcome.error = code;
+		if (outcome.valid && use_cache) remember_(std::move(keys[oldest.index]));
+		active.pop_front();
+	}
+
+	return result;
+}
+
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "change_poller.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace ldapxx {
+
+namespace {
+	/// Get the first value of an attribute, if it has any.
+	boost::optional<std::string> first_value(LDAP * connection, entry_t entry, std::string const & attribute) {
+		berval * * values = ldap_get_values_len(connection, entry, attribute.c_str());
+		if (!values) return boost::none;
+		auto free_values = at_scope_exit([values] () { ldap_value_free_len(values); });
+		if (ldap_count_values_len(values) == 0) return boost::none;
+		return std::string{values[0]->bv_val, values[0]->bv_len};
+	}
+}
+
+change_poller::change_poller(ldapxx::connection connection, ldapxx::query query, change_poller_options options, std::string const & high_water_mark) :
+	connection_{connection},
+	query_{std::move(query)},
+	options_{std::move(options)}
+{
+	if (!high_water_mark.empty()) {
+		high_water_ = parse_generalized_time(high_water_mark);
+		if (!high_water_) throw error{errc::param_error, "parsing high-water mark"};
+	}
+
+	// Make sure the timestamp and identifier are returned, without losing the user attributes.
+	std::vector<std::string> & attributes = query_.attributes;
+	if (attributes.empty()) attributes.push_back("*");
+	bool all_operational = std::any_of(attributes.begin(), attributes.end(), [] (std::string const & name) { return name == "+"; });
+	for (std::string const * needed : {&options_.timestamp_attribute, &options_.uuid_attribute}) {
+		if (all_operational) break;
+		bool found = std::any_of(attributes.begin(), attributes.end(), [&] (std::string const & name) { return iequals(name, *needed); });
+		if (!found) attributes.push_back(*needed);
+	}
+}
+
+std::string change_poller::high_water_mark() const {
+	if (!high_water_) return {};
+	return format_generalized_time(*high_water_);
+}
+
+ldapxx::query change_poller::make_query_() const {
+	ldapxx::query query = query_;
+
+	std::string filter = query_.filter.empty() ? "(objectClass=*)" : query_.filter;
+	if (filter.front() != '(') filter = "(" + filter + ")";
+
+	if (high_water_) {
+		std::string since = format_generalized_time(*high_water_ - options_.overlap);
+		query.filter = "(&(" + options_.timestamp_attribute + ">=" + since + ")" + filter + ")";
+	} else {
+		query.filter = std::move(filter);
+	}
+	return query;
+}
+
+std::size_t change_poller::poll(std::function<void (LDAP * connection, entry_t entry)> const & callback, operation_limits const & limits) {
+	std::error_code error;
+	std::size_t result = poll(callback, limits, error);
+	throw_if(error, "polling for changed entries");
+	return result;
+}
+
+std::size_t change_poller::poll(std::function<void (LDAP * connection, entry_t entry)> const & callback, operation_limits const & limits, std::error_code & error) {
+	// The entries of a partial result are in no particular order,
+	// so the high-water mark can only be moved after a complete result.
+	owned_result result = connection_.search(make_query_(), limits, options_.max_response_size, error);
+	if (error) return 0;
+
+	std::vector<entry_t> changed;
+	boost::optional<time_point> newest = high_water_;
+
+	walk_entries(connection_, result_t{result.get()}, [&] (entry_t entry) {
+		boost::optional<std::string> raw_timestamp = first_value(connection_, entry, options_.timestamp_attribute);
+		boost::optional<time_point> timestamp      = raw_timestamp ? parse_generalized_time(*raw_timestamp) : boost::none;
+
+		// Without a usable timestamp there is nothing to deduplicate on, so always report the entry.
+		if (!timestamp) {
+			changed.push_back(entry);
+			return;
+		}
+
+		boost::optional<std::string> key = first_value(connection_, entry, options_.uuid_attribute);
+		if (!key) {
+			char * dn = ldap_get_dn(connection_, entry);
+			if (dn) key = std::string{dn};
+			ldap_memfree(dn);
+		}
+
+		if (key) {
+			auto inserted = recent_.emplace(*key, *timestamp);
+			if (!inserted.second) {
+				if (inserted.first->second == *timestamp) return;
+				inserted.first->second = *timestamp;
+			}
+		}
+
+		if (!newest || *timestamp > *newest) newest = timestamp;
+		changed.push_back(entry);
+	});
+
+	high_water_ = newest;
+
+	// Entries older than the next overlap window will not be returned again.
+	if (high_water_) {
+		time_point window_start = *high_water_ - options_.overlap;
+		for (auto i = recent_.begin(); i != recent_.end();) {
+			if (i->second < window_start) i = recent_.erase(i);
+			else ++i;
+		}
+	}
+
+	for (entry_t entry : changed) callback(connection_, entry);
+	return changed.size();
+}
+
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "concurrency_limiter.hpp"
+#include "cancellation.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+
+namespace ldapxx {
+
+namespace {
+	/// Check if an error is a signal that the server is overloaded.
+	bool is_overload(std::error_code const & error) {
+		if (!error || error.category() != ldap_category()) return false;
+		errc code = errc(error.value());
+		return code == errc::busy || code == errc::unavailable || code == errc::admin_limit_exceeded || code == errc::timeout;
+	}
+}
+
+void concurrency_limiter::permit::complete(std::error_code const & error) {
+	if (!limiter_) return;
+	limiter_->release_(generation_, clock::now() - started_, &error);
+	limiter_ = nullptr;
+}
+
+void concurrency_limiter::permit::release() {
+	if (!limiter_) return;
+	limiter_->release_(generation_, clock::duration{0}, nullptr);
+	limiter_ = nullptr;
+}
+
+concurrency_limiter::concurrency_limiter(concurrency_limiter_options options) :
+	options_{options},
+	limit_{std::clamp(options.initial_limit, options.min_limit, options.max_limit)} {}
+
+bool concurrency_limiter::has_slot_() const {
+	return double(in_flight_) < std::max(1.0, limit_);
+}
+
+concurrency_limiter::permit concurrency_limiter::grant_() {
+	++in_flight_;
+	permit result;
+	result.limiter_    = this;
+	result.generation_ = generation_;
+	result.started_    = clock::now();
+	return result;
+}
+
+void concurrency_limiter::release_(std::uint64_t generation, clock::duration latency, std::error_code const * error) {
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		std::size_t in_flight = in_flight_--;
+		if (error) {
+			bool slow = options_.latency_threshold.count() > 0 && latency > options_.latency_threshold;
+			if (is_overload(*error) || slow) {
+				// Only the first signal of a burst counts.
+				if (generation == generation_) {
+					limit_ = std::max(options_.min_limit, limit_ * options_.backoff);
+					++generation_;
+					++overloads_;
+				}
+			} else if (double(in_flight) * 2 >= limit_) {
+				// Only grow while the limit is actually being used, or it would grow without bound.
+				limit_ = std::min(options_.max_limit, limit_ + options_.increase / limit_);
+			}
+		}
+	}
+	released_.notify_all();
+}
+
+concurrency_limiter::permit concurrency_limiter::acquire(std::chrono::milliseconds timeout) {
+	std::error_code error;
+	permit result = acquire(timeout, error);
+	if (error) throw ldapxx::error{errc(error.value()), "waiting for concurrency limit"};
+	return result;
+}
+
+concurrency_limiter::permit concurrency_limiter::acquire(std::chrono::milliseconds timeout, std::error_code & error) {
+	error = {};
+	std::unique_lock<std::mutex> lock{mutex_};
+	if (!has_slot_()) {
+		if (waiting_ >= options_.max_queue) {
+			++rejected_;
+			error = errc::busy;
+			return {};
+		}
+		++waiting_;
+		// A timeout of milliseconds::max(), as from operation_limits::remaining() without a deadline, waits without limit.
+		clock::time_point deadline = deadline_after(timeout);
+		auto available = [this] () { return has_slot_(); };
+		bool granted = true;
+		if (deadline == clock::time_point::max()) released_.wait(lock, available);
+		else granted = released_.wait_until(lock, deadline, available);
+		--waiting_;
+		if (!granted) {
+			++rejected_;
+			error = errc::timeout;
+			return {};
+		}
+	}
+
+	return grant_();
+}
+
+concurrency_limiter::permit concurrency_limiter::try_acquire() {
+	std::lock_guard<std::mutex> lock{mutex_};
+	if (!has_slot_()) return {};
+	return grant_();
+}
+
+bool concurrency_limiter::available() const {
+	std::lock_guard<std::mutex> lock{mutex_};
+	return has_slot_();
+}
+
+concurrency_limiter_stats concurrency_limiter::stats() const {
+	std::lock_guard<std::mutex> lock{mutex_};
+	return {limit_, in_flight_, waiting_, rejected_, overloads_};
+}
+
+}
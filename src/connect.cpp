@@ -0,0 +1,158 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "connect.hpp"
+#include "options.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace ldapxx {
+
+namespace {
+	using clock = std::chrono::steady_clock;
+
+	std::chrono::microseconds remaining(clock::time_point deadline) {
+		return std::max(std::chrono::duration_cast<std::chrono::microseconds>(deadline - clock::now()), std::chrono::microseconds{0});
+	}
+
+	/// Limit the network steps of a connection to the time left until the deadline.
+	void limit_network_timeout(LDAP * connection, connection_options const & options, clock::time_point deadline) {
+		// Without a deadline, the network timeout from the options applies as it is.
+		if (deadline == clock::time_point::max()) return;
+		std::chrono::microseconds timeout = remaining(deadline);
+		if (options.ldap.network_timeout) timeout = std::min(timeout, *options.ldap.network_timeout);
+		set_network_timeout(connection, timeout);
+	}
+
+	/// Restore the network timeout from the options after the connection is opened.
+	void restore_network_timeout(LDAP * connection, connection_options const & options) {
+		if (options.ldap.network_timeout) set_network_timeout(connection, *options.ldap.network_timeout);
+		else ldap_set_option(connection, LDAP_OPT_NETWORK_TIMEOUT, nullptr);
+	}
+
+	/// Perform the STARTTLS command on an open connection.
+	void start_tls(LDAP * connection, connection_options const & options, clock::time_point deadline, std::error_code & error) {
+		int message_id = -1;
+		error = errc(ldap_start_tls(connection, nullptr, nullptr, &message_id));
+		if (error) return;
+
+		operation_limits limits;
+		limits.deadline = deadline;
+		owned_result result = ldapxx::connection{connection}.wait_result(message_id, limits, error);
+		if (error) return;
+		errc code = result_code(connection, result, error);
+		if (error) return;
+		if (code != errc::success) {
+			error = code;
+			return;
+		}
+
+		// The TLS handshake itself is bounded by the network timeout.
+		limit_network_timeout(connection, options, deadline);
+		error = errc(ldap_install_tls(connection));
+	}
+}
+
+owned_connection connect(std::string const & uri, connection_options const & options, std::chrono::milliseconds timeout) {
+	std::error_code error;
+	owned_connection result = connect(uri, options, timeout, error);
+	if (error) throw ldapxx::error{errc(error.value()), "opening LDAP connection"};
+	return result;
+}
+
+owned_connection connect(std::string const & uri, connection_options const & options, std::chrono::milliseconds timeout, std::error_code & error) {
+	// A timeout of milliseconds::max(), as from operation_limits::remaining() without a deadline, means no deadline.
+	clock::time_point deadline = deadline_after(timeout);
+	error = {};
+
+	LDAP * ldap = nullptr;
+	error = errc(ldap_initialize(&ldap, uri.c_str()));
+	if (error) return nullptr;
+	owned_connection result{ldap};
+
+	try {
+		apply_options(result, options);
+		limit_network_timeout(result, options, deadline);
+	} catch (ldapxx::error const & e) {
+		error = e.code();
+		return nullptr;
+	}
+
+	// For LDAPS, this includes the TLS handshake.
+	error = errc(ldap_connect(result));
+	if (error) return nullptr;
+
+	if (options.tls.starttls) {
+		start_tls(result, options, deadline, error);
+		if (error) return nullptr;
+	}
+
+	try {
+		restore_network_timeout(result, options);
+	} catch (ldapxx::error const & e) {
+		error = e.code();
+		return nullptr;
+	}
+	return result;
+}
+
+std::vector<connect_result> connect_parallel(
+	std::vector<std::string> const & uris,
+	connection_options const & options,
+	std::chrono::milliseconds timeout,
+	std::size_t max_parallel
+) {
+	std::vector<connect_result> results(uris.size());
+	if (uris.empty()) return results;
+
+	// Make sure the global state of the library is initialized before using it from multiple threads.
+	int version;
+	ldap_get_option(nullptr, LDAP_OPT_PROTOCOL_VERSION, &version);
+
+	std::atomic<std::size_t> next{0};
+	auto worker = [&] () {
+		for (std::size_t i = next++; i < uris.size(); i = next++) {
+			results[i].connection = connect(uris[i], options, timeout, results[i].error);
+		}
+	};
+
+	std::size_t thread_count = std::min(std::max<std::size_t>(max_parallel, 1), uris.size());
+	std::vector<std::thread> threads;
+	threads.reserve(thread_count - 1);
+	auto join = at_scope_exit([&] () {
+		for (std::thread & thread : threads) thread.join();
+	});
+
+	for (std::size_t i = 1; i < thread_count; ++i) threads.emplace_back(worker);
+	worker();
+	return results;
+}
+
+}
@@ -25,8 +25,18 @@
  */
 
 #include "connection.hpp"
+#include "modification_buffer.hpp"
 #include "options.hpp"
+#include "tls_context.hpp"
+#include "tls_session_cache.hpp"
 #include "util.hpp"
+#include "walk_result.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace ldapxx {
 
@@ -53,15 +63,22 @@ void apply_options(LDAP * connection, connection_options::tcp_options const & op
 
 void apply_options(LDAP * connection, connection_options::tls_options const & options) {
 	set_if(connection, options.require_cert, set_tls_require_cert);
-	set_if(connection, options.cacertdir,    set_tls_cacertdir);
-	set_if(connection, options.cacertfile,   set_tls_cacertfile);
-	set_if(connection, options.ciphersuite,  set_tls_cipher_suite);
-	set_if(connection, options.crlcheck,     set_tls_crlcheck);
-	set_if(connection, options.crlfile,      set_tls_crlfile);
-	set_if(connection, options.dhfile,       set_tls_dhfile);
-	set_if(connection, options.keyfile,      set_tls_keyfile);
-	set_if(connection, options.protocol_min, set_tls_protocol_min);
-	set_if(connection, options.random_file,  set_tls_random_file);
+	if (options.context) {
+		set_tls_context(connection, options.context->native());
+	} else {
+		set_if(connection, options.cacertdir,    set_tls_cacertdir);
+		set_if(connection, options.cacertfile,   set_tls_cacertfile);
+		set_if(connection, options.ciphersuite,  set_tls_cipher_suite);
+		set_if(connection, options.crlcheck,     set_tls_crlcheck);
+		set_if(connection, options.crlfile,      set_tls_crlfile);
+		set_if(connection, options.dhfile,       set_tls_dhfile);
+		set_if(connection, options.keyfile,      set_tls_keyfile);
+		set_if(connection, options.protocol_min, set_tls_protocol_min);
+		set_if(connection, options.random_file,  set_tls_random_file);
+	}
+
+	// The session cache configures the TLS context, so it must be attached after the context is set up.
+	if (options.session_cache) options.session_cache->attach(connection);
 }
 
 void apply_options(LDAP * connection, connection_options const & options) {
@@ -80,88 +97,232 @@ connection::connection(std::string const & uri, connection_options const & optio
 	}
 }
 
+namespace {
+	/// Free an LDAP control by calling ldap_control_free().
+	struct control_deleter {
+		void operator() (LDAPControl * control) { ldap_control_free(control); }
+	};
+
+	/// The server controls of a search: the controls requested by the query, followed by extra controls.
+	class search_controls {
+		std::unique_ptr<LDAPControl, control_deleter> sort_;
+		std::vector<LDAPControl *> controls_;
+		LDAPControl * * native_ = nullptr;
+
+	public:
+		search_controls(LDAP * connection, query const & query, LDAPControl * * extra, std::error_code & error) {
+			native_ = extra;
+			if (query.sort.empty()) return;
+
+			std::vector<LDAPSortKey> keys;
+			keys.reserve(query.sort.size());
+			for (sort_key const & key : query.sort) {
+				keys.push_back(LDAPSortKey{
+					const_cast<char *>(key.attribute.c_str()),
+					key.ordering_rule.empty() ? nullptr : const_cast<char *>(key.ordering_rule.c_str()),
+					key.reverse
+				});
+			}
+			std::vector<LDAPSortKey *> key_list;
+			for (LDAPSortKey & key : keys) key_list.push_back(&key);
+			key_list.push_back(nullptr);
+
+			// Critical, because silently unsorted results are worse than an error.
+			LDAPControl * sort = nullptr;
+			error = errc(ldap_create_sort_control(connection, key_list.data(), 1, &sort));
+			if (error) return;
+			sort_.reset(sort);
+
+			controls_.push_back(sort);
+			for (LDAPControl * * control = extra; control && *control; ++control) controls_.push_back(*control);
+			controls_.push_back(nullptr);
+			native_ = controls_.data();
+		}
+
+		/// Get the null terminated list of controls, or null if there are none.
+		LDAPControl * * native() const { return native_; }
+	};
+
+	/// Convert the result code of a compare operation to a boolean or an error.
+	bool compare_outcome(errc code, std::error_code & error) {
+		error = {};
+		if (code == errc::compare_true)  return true;
+		if (code == errc::compare_false) return false;
+		error = code;
+		return false;
+	}
+
+	/// Check if an error code is a timeout.
+	bool is_timeout(std::error_code const & error) {
+		return error.category() == ldap_category() && errc(error.value()) == errc::timeout;
+	}
+
+	/// Wait for the result of a request within limits and check its result code.
+	void check_result(connection & connection, int message_id, operation_limits const & limits, std::error_code & error) {
+		owned_result result = connection.wait_result(message_id, limits, error);
+		if (error) return;
+		errc code = result_code(connection, result, error);
+		if (error) return;
+		if (code != errc::success) error = code;
+	}
+}
+
 void connection::simple_bind(std::string const & dn, std::string_view password) {
+	std::error_code error;
+	simple_bind(dn, password, error);
+	throw_if(error, "performing simple bind");
+}
+
+void connection::simple_bind(std::string const & dn, std::string_view password, std::error_code & error) {
 	berval ber_password = to_berval(password);
-	int error = ldap_sasl_bind_s(ldap_, dn.c_str(), LDAP_SASL_SIMPLE, &ber_password, nullptr, nullptr, nullptr);
-	if (error) throw ldapxx::error{errc(error), "performing simple bind"};
+	error = errc(ldap_sasl_bind_s(ldap_, dn.c_str(), LDAP_SASL_SIMPLE, &ber_password, nullptr, nullptr, nullptr));
+}
+
+void connection::simple_bind(std::string const & dn, std::string_view password, operation_limits const & limits) {
+	std::error_code error;
+	simple_bind(dn, password, limits, error);
+	throw_if(error, "performing simple bind");
+}
+
+void connection::simple_bind(std::string const & dn, std::string_view password, operation_limits const & limits, std::error_code & error) {
+	berval ber_password = to_berval(password);
+	int message_id = -1;
+	error = errc(ldap_sasl_bind(ldap_, dn.c_str(), LDAP_SASL_SIMPLE, &ber_password, nullptr, nullptr, &message_id));
+	if (error) return;
+	check_result(*this, message_id, limits, error);
 }
 
 owned_result connection::search(query const & query, std::chrono::milliseconds timeout, std::size_t max_response) {
+	std::error_code error;
+	owned_result result = search(query, timeout, max_response, error);
+	throw_if(error, "performing LDAP search");
+	return result;
+}
+
+owned_result connection::search(query const & query, std::chrono::milliseconds timeout, std::size_t max_response, std::error_code & error) {
 	timeval timeout_c = to_timeval(timeout);
 	std::vector<char const *> attributes_c = to_cstr_array(query.attributes);
+	search_controls controls{ldap_, query, nullptr, error};
+	if (error) return nullptr;
 
 	LDAPMessage * result = nullptr;
-	int error = ldap_search_ext_s(
+	error = errc(ldap_search_ext_s(
 		ldap_,
 		query.base.data(),
 		int(query.scope),
 		query.filter.data(),
 		const_cast<char * *>(attributes_c.data()),
-		0, nullptr, nullptr,
+		0, controls.native(), nullptr,
 		&timeout_c,
 		max_response,
 		&result
-	);
+	));
 
-	// Wrap result in unique_ptr before throwing error, because it has to be freed either way.
-	owned_result safe_result{result};
-	if (error) throw ldapxx::error{errc(error), "performing LDAP search"};
-	return safe_result;
+	// Wrap result in unique_ptr, because it has to be freed either way.
+	return owned_result{result};
 }
 
-namespace {
-	int to_ldap_mod_op(modification_type type) {
-		switch (type) {
-			case modification_type::add:              return LDAP_MOD_ADD;
-			case modification_type::remove_values:    return LDAP_MOD_DELETE;
-			case modification_type::remove_attribute: return LDAP_MOD_DELETE;
-			case modification_type::replace:          return LDAP_MOD_REPLACE;
-		}
-		throw std::logic_error("unknown modification type: " + std::to_string(int(type)));
+owned_result connection::search(query const & query, operation_limits const & limits, std::size_t max_response) {
+	std::error_code error;
+	owned_result result = search(query, limits, max_response, error);
+	throw_if(error, "performing LDAP search");
+	return result;
+}
+
+owned_result connection::search(query const & query, operation_limits const & limits, std::size_t max_response, std::error_code & error) {
+	if (limits.remaining().count() == 0) {
+		error = errc::timeout;
+		return nullptr;
 	}
+
+	int message_id = search_async(query, limits.time_limit(), max_response, nullptr, error);
+	if (error) return nullptr;
+	owned_result result = wait_result(message_id, limits, error);
+	if (error) return result;
+
+	// Report the result code like the synchronous search does, keeping partial results.
+	errc code = result_code(ldap_, result, error);
+	if (!error && code != errc::success) error = code;
+	return result;
+}
+
+int connection::search_async(query const & query, std::chrono::milliseconds time_limit, std::size_t max_response, LDAPControl * * server_controls) {
+	std::error_code error;
+	int message_id = search_async(query, time_limit, max_response, server_controls, error);
+	throw_if(error, "sending LDAP search");
+	return message_id;
+}
+
+int connection::search_async(query const & query, std::chrono::milliseconds time_limit, std::size_t max_response, LDAPControl * * server_controls, std::error_code & error) {
+	std::vector<char const *> attributes_c = to_cstr_array(query.attributes);
+	search_controls controls{ldap_, query, server_controls, error};
+	if (error) return -1;
+
+	// The server time limit has a granularity of seconds, so round up.
+	// libldap rejects a zero timeout, so pass no timeout at all for "no limit".
+	// Limits that don't fit in the protocol field are no limit either.
+	std::chrono::seconds time_limit_s = std::chrono::ceil<std::chrono::seconds>(std::max(time_limit, std::chrono::milliseconds{0}));
+	bool limited = time_limit_s.count() > 0 && time_limit_s.count() <= std::numeric_limits<int>::max();
+	timeval time_limit_c = to_timeval(limited ? time_limit_s : std::chrono::seconds{0});
+
+	int message_id = -1;
+	error = errc(ldap_search_ext(
+		ldap_,
+		query.base.data(),
+		int(query.scope),
+		query.filter.data(),
+		const_cast<char * *>(attributes_c.data()),
+		query.attributes_only,
+		controls.native(),
+		nullptr,
+		limited ? &time_limit_c : nullptr,
+		max_response,
+		&message_id
+	));
+	return message_id;
 }
 
 void connection::modify(std::string const & dn, std::vector<modification> const & modifications) {
-	// First convert to stupid LDAP API structures.
-	std::vector<ldapmod> ldap_mods;
-	std::vector<LDAPMod *> ldap_mod_ptrs;
-	std::vector<std::vector<berval>> bervals;
-	std::vector<std::vector<berval *>> berval_ptrs;
-
-	// Can't have the vectors resize, it would invalidate pointers.
-	ldap_mods.reserve(modifications.size());
-	ldap_mod_ptrs.reserve(modifications.size() + 1);
-	bervals.reserve(modifications.size());
-	berval_ptrs.reserve(modifications.size() + 1);
-
-	for (modification const & modification : modifications) {
-		// Basic LDAPMod information.
-		ldap_mods.push_back(ldapmod{});
-		ldap_mod_ptrs.push_back(&ldap_mods.back());
-		ldap_mods.back().mod_op = to_ldap_mod_op(modification.type) | LDAP_MOD_BVALUES;
-		ldap_mods.back().mod_type = const_cast<char *>(modification.attribute.c_str());
-
-		// Delete whole attribute?
-		if (modification.type == modification_type::remove_attribute) {
-			ldap_mods.back().mod_op = LDAP_MOD_DELETE;
-			ldap_mods.back().mod_vals.modv_strvals = nullptr;
-			continue;
-		}
+	std::error_code error;
+	modify(dn, modifications, error);
+	throw_if(error, "applying modifications");
+}
 
-		// Add bervals.
-		bervals.emplace_back(toBervals(modification.values));
-		berval_ptrs.emplace_back(toPtrs(bervals.back()));
-		ldap_mods.back().mod_vals.modv_bvals = berval_ptrs.back().data();
-	}
+void connection::modify(std::string const & dn, std::vector<modification> const & modifications, std::error_code & error) {
+	modification_buffer buffer;
+	for (modification const & modification : modifications) buffer.add(modification);
+	modify(dn, buffer, error);
+}
 
-	ldap_mod_ptrs.push_back(nullptr);
+void connection::modify(std::string const & dn, modification_buffer & modifications) {
+	std::error_code error;
+	modify(dn, modifications, error);
+	throw_if(error, "applying modifications");
+}
 
-	// Then pass to LDAP -.-
-	int error = ldap_modify_ext_s(ldap_, dn.c_str(), ldap_mod_ptrs.data(), nullptr, nullptr);
-	if (error) throw ldapxx::error{errc(error), "applying modifications"};
+void connection::modify(std::string const & dn, modification_buffer & modifications, std::error_code & error) {
+	error = errc(ldap_modify_ext_s(ldap_, dn.c_str(), modifications.native(), nullptr, nullptr));
+}
+
+void connection::modify(std::string const & dn, modification_buffer & modifications, operation_limits const & limits) {
+	std::error_code error;
+	modify(dn, modifications, limits, error);
+	throw_if(error, "applying modifications");
+}
+
+void connection::modify(std::string const & dn, modification_buffer & modifications, operation_limits const & limits, std::error_code & error) {
+	int message_id = modify_async(dn, modifications, nullptr, error);
+	if (error) return;
+	check_result(*this, message_id, limits, error);
 }
 
 void connection::add_attribute_value(std::string const & dn, std::string const & attribute, std::string_view value) {
+	std::error_code error;
+	add_attribute_value(dn, attribute, value, error);
+	throw_if(error, "adding attribute value");
+}
+
+void connection::add_attribute_value(std::string const & dn, std::string const & attribute, std::string_view value, std::error_code & error) {
 	berval ldap_value = to_berval(value);
 	std::array<berval *, 2> values{{&ldap_value, nullptr}};
 
@@ -171,11 +332,16 @@ void connection::add_attribute_value(std::string const & dn, std::string const &
 	ldap_mod.mod_vals.modv_bvals = values.data();
 	std::array<LDAPMod *, 2> mods{{&ldap_mod, nullptr}};
 
-	int error = ldap_modify_ext_s(ldap_, dn.c_str(), mods.data(), nullptr, nullptr);
-	if (error) throw ldapxx::error{errc(error), "adding attribute value"};
+	error = errc(ldap_modify_ext_s(ldap_, dn.c_str(), mods.data(), nullptr, nullptr));
 }
 
 void connection::remove_attribute_value(std::string const & dn, std::string const & attribute, std::string_view value) {
+	std::error_code error;
+	remove_attribute_value(dn, attribute, value, error);
+	throw_if(error, "deleting attribute value");
+}
+
+void connection::remove_attribute_value(std::string const & dn, std::string const & attribute, std::string_view value, std::error_code & error) {
 	berval ldap_value = to_berval(value);
 	std::array<berval *, 2> values{{&ldap_value, nullptr}};
 
@@ -185,51 +351,267 @@ void connection::remove_attribute_value(std::string const & dn, std::string cons
 	ldap_mod.mod_vals.modv_bvals = values.data();
 	std::array<LDAPMod *, 2> mods{{&ldap_mod, nullptr}};
 
-	int error = ldap_modify_ext_s(ldap_, dn.c_str(), mods.data(), nullptr, nullptr);
-	if (error) throw ldapxx::error{errc(error), "deleting attribute value"};
+	error = errc(ldap_modify_ext_s(ldap_, dn.c_str(), mods.data(), nullptr, nullptr));
 }
 
 void connection::remove_attribute(std::string const & dn, std::string const & attribute) {
+	std::error_code error;
+	remove_attribute(dn, attribute, error);
+	throw_if(error, "deleting attribute value");
+}
+
+void connection::remove_attribute(std::string const & dn, std::string const & attribute, std::error_code & error) {
 	LDAPMod ldap_mod;
 	ldap_mod.mod_op = LDAP_MOD_DELETE;
 	ldap_mod.mod_type = const_cast<char *>(attribute.c_str());
 	ldap_mod.mod_vals.modv_strvals = nullptr;
 	std::array<LDAPMod *, 2> mods{{&ldap_mod, nullptr}};
 
-	int error = ldap_modify_ext_s(ldap_, dn.c_str(), mods.data(), nullptr, nullptr);
-	if (error) throw ldapxx::error{errc(error), "deleting attribute value"};
+	error = errc(ldap_modify_ext_s(ldap_, dn.c_str(), mods.data(), nullptr, nullptr));
 }
 
 void connection::add_entry(std::string const & dn, std::map<std::string, std::vector<std::string>> const & attributes) {
-	std::vector<ldapmod> ldap_mods;
-	std::vector<std::vector<berval>> bervals;
-	std::vector<std::vector<berval *>> berval_ptrs;
-
-	ldap_mods.reserve(attributes.size());
-	bervals.reserve(attributes.size());
-	berval_ptrs.reserve(attributes.size() + 1);
+	std::error_code error;
+	add_entry(dn, attributes, error);
+	throw_if(error, "adding entry");
+}
 
+void connection::add_entry(std::string const & dn, std::map<std::string, std::vector<std::string>> const & attributes, std::error_code & error) {
+	modification_buffer buffer;
 	for (auto const & attribute : attributes) {
-		// Basic LDAPMod information.
-		ldap_mods.push_back(ldapmod{});
-		ldap_mods.back().mod_op = LDAP_MOD_ADD | LDAP_MOD_BVALUES;
-		ldap_mods.back().mod_type = const_cast<char *>(attribute.first.c_str());
-
-		// Add bervals.
-		bervals.emplace_back(toBervals(attribute.second));
-		berval_ptrs.emplace_back(toPtrs(bervals.back()));
-		ldap_mods.back().mod_vals.modv_bvals = berval_ptrs.back().data();
+		buffer.add(modification_type::add, attribute.first, attribute.second.begin(), attribute.second.end());
 	}
+	add_entry(dn, buffer, error);
+}
+
+void connection::add_entry(std::string const & dn, modification_buffer & attributes) {
+	std::error_code error;
+	add_entry(dn, attributes, error);
+	throw_if(error, "adding entry");
+}
+
+void connection::add_entry(std::string const & dn, modification_buffer & attributes, std::error_code & error) {
+	error = errc(ldap_add_ext_s(ldap_, dn.c_str(), attributes.native(), nullptr, nullptr));
+}
 
-	std::vector<LDAPMod *> mod_ptrs = toPtrs(ldap_mods);
+void connection::add_entry(std::string const & dn, modification_buffer & attributes, operation_limits const & limits) {
+	std::error_code error;
+	add_entry(dn, attributes, limits, error);
+	throw_if(error, "adding entry");
+}
 
-	int error = ldap_add_ext_s(ldap_, dn.c_str(), mod_ptrs.data(), nullptr, nullptr);
-	if (error) throw ldapxx::error{errc(error), "adding entry"};
+void connection::add_entry(std::string const & dn, modification_buffer & attributes, operation_limits const & limits, std::error_code & error) {
+	int message_id = add_entry_async(dn, attributes, nullptr, error);
+	if (error) return;
+	check_result(*this, message_id, limits, error);
 }
 
 void connection::remove_entry(std::string const & dn) {
-	int error = ldap_delete_ext_s(ldap_, dn.c_str(), nullptr, nullptr);
-	if (error) throw ldapxx::error{errc(error), "deleting entry"};
+	std::error_code error;
+	remove_entry(dn, error);
+	throw_if(error, "deleting entry");
+}
+
+void connection::remove_entry(std::string const & dn, std::error_code & error) {
+	error = errc(ldap_delete_ext_s(ldap_, dn.c_str(), nullptr, nullptr));
+}
+
+void connection::remove_entry(std::string const & dn, operation_limits const & limits) {
+	std::error_code error;
+	remove_entry(dn, limits, error);
+	throw_if(error, "deleting entry");
+}
+
+void connection::remove_entry(std::string const & dn, operation_limits const & limits, std::error_code & error) {
+	int message_id = remove_entry_async(dn, nullptr, error);
+	if (error) return;
+	check_result(*this, message_id, limits, error);
+}
+
+int connection::modify_async(std::string const & dn, modification_buffer & modifications, LDAPControl * * server_controls) {
+	std::error_code error;
+	int message_id = modify_async(dn, modifications, server_controls, error);
+	throw_if(error, "sending modify request");
+	return message_id;
+}
+
+int connection::modify_async(std::string const & dn, modification_buffer & modifications, LDAPControl * * server_controls, std::error_code & error) {
+	int message_id = -1;
+	error = errc(ldap_modify_ext(ldap_, dn.c_str(), modifications.native(), server_controls, nullptr, &message_id));
+	return message_id;
+}
+
+int connection::add_entry_async(std::string const & dn, modification_buffer & attributes, LDAPControl * * server_controls) {
+	std::error_code error;
+	int message_id = add_entry_async(dn, attributes, server_controls, error);
+	throw_if(error, "sending add request");
+	return message_id;
+}
+
+int connection::add_entry_async(std::string const & dn, modification_buffer & attributes, LDAPControl * * server_controls, std::error_code & error) {
+	int message_id = -1;
+	error = errc(ldap_add_ext(ldap_, dn.c_str(), attributes.native(), server_controls, nullptr, &message_id));
+	return message_id;
+}
+
+int connection::remove_entry_async(std::string const & dn, LDAPControl * * server_controls) {
+	std::error_code error;
+	int message_id = remove_entry_async(dn, server_controls, error);
+	throw_if(error, "sending delete request");
+	return message_id;
+}
+
+int connection::remove_entry_async(std::string const & dn, LDAPControl * * server_controls, std::error_code & error) {
+	int message_id = -1;
+	error = errc(ldap_delete_ext(ldap_, dn.c_str(), server_controls, nullptr, &message_id));
+	return message_id;
+}
+
+bool connection::compare(std::string const & dn, std::string const & attribute, std::string_view value) {
+	std::error_code error;
+	bool result = compare(dn, attribute, value, error);
+	throw_if(error, "comparing attribute value");
+	return result;
+}
+
+bool connection::compare(std::string const & dn, std::string const & attribute, std::string_view value, std::error_code & error) {
+	berval ldap_value = to_berval(value);
+	return compare_outcome(errc(ldap_compare_ext_s(ldap_, dn.c_str(), attribute.c_str(), &ldap_value, nullptr, nullptr)), error);
+}
+
+bool connection::compare(std::string const & dn, std::string const & attribute, std::string_view value, operation_limits const & limits) {
+	std::error_code error;
+	bool result = compare(dn, attribute, value, limits, error);
+	throw_if(error, "comparing attribute value");
+	return result;
+}
+
+bool connection::compare(std::string const & dn, std::string const & attribute, std::string_view value, operation_limits const & limits, std::error_code & error) {
+	int message_id = compare_async(dn, attribute, value, error);
+	if (error) return false;
+	owned_result result = wait_result(message_id, limits, error);
+	if (error) return false;
+	errc code = result_code(ldap_, result, error);
+	if (error) return false;
+	return compare_outcome(code, error);
+}
+
+std::vector<bool> connection::compare(std::vector<compare_request> const & requests, std::chrono::milliseconds timeout) {
+	std::error_code error;
+	std::vector<bool> result = compare(requests, timeout, error);
+	throw_if(error, "comparing attribute values");
+	return result;
+}
+
+std::vector<bool> connection::compare(std::vector<compare_request> const & requests, std::chrono::milliseconds timeout, std::error_code & error) {
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	error = {};
+
+	// Pairs of message ID and request index, sorted by message ID for lookup.
+	std::vector<std::pair<int, std::size_t>> pending;
+	pending.reserve(requests.size());
+
+	// Make sure the server stops working on requests we're no longer waiting for.
+	auto abandon_pending = at_scope_exit([&] () {
+		for (auto const & request : pending) ldap_abandon_ext(ldap_, request.first, nullptr, nullptr);
+	});
+
+	for (std::size_t i = 0; i < requests.size(); ++i) {
+		int message_id = compare_async(requests[i].dn, requests[i].attribute, requests[i].value, error);
+		if (error) return {};
+		pending.emplace_back(message_id, i);
+	}
+	std::sort(pending.begin(), pending.end());
+
+	std::vector<bool> results(requests.size());
+	while (!pending.empty()) {
+		auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		timeval timeout_c = to_timeval(std::max(remaining, std::chrono::microseconds{0}));
+
+		LDAPMessage * result = nullptr;
+		int type = ldap_result(ldap_, LDAP_RES_ANY, LDAP_MSG_ALL, &timeout_c, &result);
+		owned_result safe_result{result};
+		if (type == -1) { error = last_result_code(ldap_); return {}; }
+		if (type ==  0) { error = errc::timeout;           return {}; }
+
+		auto request = std::lower_bound(pending.begin(), pending.end(), std::make_pair(ldap_msgid(result), std::size_t(0)));
+		if (request == pending.end() || request->first != ldap_msgid(result)) continue;
+
+		errc code = result_code(ldap_, result_t{result}, error);
+		if (error) return {};
+		results[request->second] = compare_outcome(code, error);
+		if (error) return {};
+		pending.erase(request);
+	}
+
+	return results;
+}
+
+int connection::compare_async(std::string const & dn, std::string const & attribute, std::string_view value) {
+	std::error_code error;
+	int message_id = compare_async(dn, attribute, value, error);
+	throw_if(error, "sending compare request");
+	return message_id;
+}
+
+int connection::compare_async(std::string const & dn, std::string const & attribute, std::string_view value, std::error_code & error) {
+	berval ldap_value = to_berval(value);
+	int message_id = -1;
+	error = errc(ldap_compare_ext(ldap_, dn.c_str(), attribute.c_str(), &ldap_value, nullptr, nullptr, &message_id));
+	return message_id;
+}
+
+bool connection::compare_result(int message_id, std::chrono::milliseconds timeout) {
+	std::error_code error;
+	bool result = compare_result(message_id, timeout, error);
+	throw_if(error, "comparing attribute value");
+	return result;
+}
+
+bool connection::compare_result(int message_id, std::chrono::milliseconds timeout, std::error_code & error) {
+	owned_result result = wait_result(message_id, timeout, error);
+	if (error) return false;
+	errc code = result_code(ldap_, result, error);
+	if (error) return false;
+	return compare_outcome(code, error);
+}
+
+owned_result connection::wait_result(int message_id, std::chrono::milliseconds timeout) {
+	std::error_code error;
+	owned_result result = wait_result(message_id, timeout, error);
+	throw_if(error, "waiting for result");
+	return result;
+}
+
+owned_result connection::wait_result(int message_id, std::chrono::milliseconds timeout, std::error_code & error) {
+	timeval timeout_c = to_timeval(timeout);
+	LDAPMessage * result = nullptr;
+	int type = ldap_result(ldap_, message_id, LDAP_MSG_ALL, &timeout_c, &result);
+
+	// Wrap result in unique_ptr, because it has to be freed either way.
+	owned_result safe_result{result};
+	if      (type == -1) error = last_result_code(ldap_);
+	else if (type ==  0) error = errc::timeout;
+	else                 error = {};
+	return safe_result;
+}
+
+owned_result connection::wait_result(int message_id, operation_limits const & limits) {
+	std::error_code error;
+	owned_result result = wait_result(message_id, limits, error);
+	throw_if(error, "waiting for result");
+	return result;
+}
+
+owned_result connection::wait_result(int message_id, operation_limits const & limits, std::error_code & error) {
+	owned_result result;
+	bool done = limits.wait_in_slices([&] (std::chrono::milliseconds slice) {
+		result = wait_result(message_id, slice, error);
+		return !is_timeout(error);
+	}, error);
+
+	if (!done) ldap_abandon_ext(ldap_, message_id, nullptr, nullptr);
+	return result;
 }
 
 }
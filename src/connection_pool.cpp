@@ -0,0 +1,192 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "connection_pool.hpp"
+#include "connect.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace ldapxx {
+
+namespace {
+	using clock = std::chrono::steady_clock;
+
+	/// Compute the deadline for a timeout, or no deadline if it would overflow.
+	/**
+	 * This makes operation_limits::remaining() of an unlimited operation wait forever.
+	 */
+	boost::optional<clock::time_point> optional_deadline(std::chrono::milliseconds timeout) {
+		clock::time_point deadline = deadline_after(timeout);
+		if (deadline == clock::time_point::max()) return boost::none;
+		return deadline;
+	}
+}
+
+connection_pool::connection_pool(
+	std::string uri,
+	connection_options options,
+	std::size_t max_size,
+	boost::optional<bind_credentials> service
+) :
+	uri_{std::move(uri)},
+	options_{std::move(options)},
+	service_{std::move(service)},
+	max_size_{std::max<std::size_t>(max_size, 1)} {}
+
+connection_pool::~connection_pool() {
+	for (slot & slot : idle_) ldap_unbind_ext_s(slot.ldap, nullptr, nullptr);
+}
+
+connection_pool::slot connection_pool::open_() {
+	ldapxx::connection connection{uri_, options_};
+	// A fresh connection is anonymous, which is the service identity if no credentials are configured.
+	return {connection.native(), bool(service_)};
+}
+
+void connection_pool::prepare_(slot & slot, bool service_identity) {
+	if (!service_identity || !slot.rebound) return;
+	ldapxx::connection connection{slot.ldap};
+	if (service_) connection.simple_bind(service_->dn, service_->password);
+	else connection.simple_bind("", "");
+	slot.rebound = false;
+}
+
+void connection_pool::release_(slot slot) {
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		idle_.push_back(slot);
+	}
+	released_.notify_one();
+}
+
+void connection_pool::discard_(slot slot) {
+	ldap_unbind_ext_s(slot.ldap, nullptr, nullptr);
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		--size_;
+	}
+	released_.notify_one();
+}
+
+connection_pool::lease connection_pool::acquire_(boost::optional<std::chrono::steady_clock::time_point> deadline, bool wait, bool service_identity) {
+	std::unique_lock<std::mutex> lock{mutex_};
+	auto available = [this] () { return !idle_.empty() || size_ < max_size_; };
+
+	if (!wait) {
+		if (!available()) return {};
+	} else if (deadline) {
+		if (!released_.wait_until(lock, *deadline, available)) return {};
+	} else {
+		released_.wait(lock, available);
+	}
+
+	slot slot;
+	if (!idle_.empty()) {
+		slot = idle_.back();
+		idle_.pop_back();
+		lock.unlock();
+	} else {
+		// Reserve the place in the pool before opening the connection without holding the lock.
+		++size_;
+		lock.unlock();
+		try {
+			slot = open_();
+		} catch (...) {
+			lock.lock();
+			--size_;
+			lock.unlock();
+			released_.notify_one();
+			throw;
+		}
+	}
+
+	lease result{this, slot};
+	try {
+		prepare_(result.slot_, service_identity);
+	} catch (...) {
+		result.discard();
+		throw;
+	}
+	return result;
+}
+
+std::size_t connection_pool::warm_up(std::size_t count, std::chrono::milliseconds timeout) {
+	// Reserve the places in the pool before opening the connections without holding the lock.
+	std::size_t reserved;
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		reserved = std::min(count, max_size_ - size_);
+		size_ += reserved;
+	}
+
+	std::vector<connect_result> results;
+	try {
+		results = connect_parallel(std::vector<std::string>(reserved, uri_), options_, timeout);
+	} catch (...) {
+		{
+			std::lock_guard<std::mutex> lock{mutex_};
+			size_ -= reserved;
+		}
+		released_.notify_all();
+		throw;
+	}
+
+	std::size_t opened = 0;
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		for (connect_result & result : results) {
+			if (!result.connection) continue;
+			idle_.push_back({result.connection.release(), bool(service_)});
+			++opened;
+		}
+		size_ -= reserved - opened;
+	}
+	released_.notify_all();
+	return opened;
+}
+
+connection_pool::lease connection_pool::acquire() {
+	return acquire_(boost::none, true, true);
+}
+
+connection_pool::lease connection_pool::acquire(std::chrono::milliseconds timeout) {
+	return acquire_(optional_deadline(timeout), true, true);
+}
+
+connection_pool::lease connection_pool::try_acquire() {
+	return acquire_(boost::none, false, true);
+}
+
+connection_pool::lease connection_pool::acquire_unbound(std::chrono::milliseconds timeout) {
+	return acquire_(optional_deadline(timeout), true, false);
+}
+
+connection_pool::lease connection_pool::try_acquire_unbound() {
+	return acquire_(boost::none, false, false);
+}
+
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "crawler.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+namespace ldapxx {
+
+namespace {
+	constexpr char const * has_subordinates = "hasSubordinates";
+
+	/// Check if an error means the connection itself is unusable.
+	bool is_connection_error(std::error_code const & error) {
+		if (error.category() != ldap_category()) return false;
+		return errc(error.value()) == errc::server_down || errc(error.value()) == errc::connect_error;
+	}
+
+	/// Check if an entry may have children, according to its hasSubordinates attribute.
+	bool is_container(LDAP * connection, entry_t entry, bool descend_unknown) {
+		berval * * values = ldap_get_values_len(connection, entry, has_subordinates);
+		if (!values) return descend_unknown;
+		auto free_values = at_scope_exit([values] () { ldap_value_free_len(values); });
+		if (ldap_count_values_len(values) == 0) return descend_unknown;
+		return iequals(std::string_view{values[0]->bv_val, values[0]->bv_len}, "TRUE");
+	}
+}
+
+directory_crawler::directory_crawler(connection_pool & pool, std::vector<std::string> const & bases, crawler_options options) :
+	pool_{pool},
+	options_{std::move(options)}
+{
+	std::size_t threads = std::max<std::size_t>(1, std::min(options_.threads, pool_.max_size()));
+	for (std::size_t i = 0; i < threads; ++i) workers_.push_back(std::make_unique<worker>());
+
+	for (std::size_t i = 0; i < bases.size(); ++i) workers_[i % threads]->queue.push_back(bases[i]);
+	queued_  = bases.size();
+	pending_ = bases.size();
+
+	std::vector<std::string> & attributes = options_.attributes;
+	bool requested = std::any_of(attributes.begin(), attributes.end(), [] (std::string const & name) {
+		return name == "+" || iequals(name, has_subordinates);
+	});
+	if (!requested) attributes.push_back(has_subordinates);
+}
+
+void directory_crawler::run(consumer const & consumer, operation_limits const & limits) {
+	std::error_code error;
+	run(consumer, limits, error);
+	throw_if(error, "crawling directory");
+}
+
+void directory_crawler::run(consumer const & consumer, operation_limits const & limits, std::error_code & error) {
+	error      = {};
+	error_     = {};
+	exception_ = nullptr;
+	stop_      = false;
+
+	// Containers that were being searched when a previous run stopped must be searched again.
+	for (std::unique_ptr<worker> & worker : workers_) {
+		std::lock_guard<std::mutex> lock{worker->mutex};
+		if (!worker->current) continue;
+		worker->queue.push_back(std::move(*worker->current));
+		worker->current.reset();
+		++queued_;
+	}
+
+	if (pending_.load() == 0) return;
+
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < workers_.size(); ++i) {
+		threads.emplace_back([this, i, &consumer, &limits] () { work_(i, consumer, limits); });
+	}
+	for (std::thread & thread : threads) thread.join();
+
+	if (exception_) std::rethrow_exception(exception_);
+	error = error_;
+}
+
+std::vector<std::string> directory_crawler::checkpoint() {
+	// Lock all queues at once, so that no container is missed while it moves between workers.
+	std::vector<std::unique_lock<std::mutex>> locks;
+	for (std::unique_ptr<worker> & worker : workers_) locks.emplace_back(worker->mutex);
+
+	std::vector<std::string> result;
+	for (std::unique_ptr<worker> & worker : workers_) {
+		if (worker->current) result.push_back(*worker->current);
+		result.insert(result.end(), worker->queue.begin(), worker->queue.end());
+	}
+	return result;
+}
+
+crawler_stats directory_crawler::stats() const {
+	crawler_stats result;
+	result.entries    = entries_.load(std::memory_order_relaxed);
+	result.containers = containers_.load(std::memory_order_relaxed);
+	result.steals     = steals_.load(std::memory_order_relaxed);
+	return result;
+}
+
+void directory_crawler::work_(std::size_t index, consumer const & consumer, operation_limits const & limits) {
+	connection_pool::lease lease;
+
+	while (!stop_) {
+		if (limits.cancelled()) {
+			fail_(errc::user_cancelled);
+			return;
+		}
+
+		if (!take_(index)) {
+			std::unique_lock<std::mutex> lock{idle_mutex_};
+			idle_.wait(lock, [this] () { return stop_ || queued_ > 0 || pending_ == 0; });
+			if (stop_ || pending_ == 0) return;
+
+			// Another worker may take the queued container first, so try again instead of giving up.
+			continue;
+		}
+
+		try {
+			if (!lease) {
+				lease = pool_.acquire(limits.remaining());
+				if (!lease) {
+					fail_(errc::timeout);
+					return;
+				}
+			}
+
+			std::error_code error;
+			crawl_(index, lease, consumer, limits, error);
+			if (error) {
+				if (is_connection_error(error)) lease.discard();
+				fail_(error);
+				return;
+			}
+		} catch (ldapxx::error const & error) {
+			fail_(error.code());
+			return;
+		} catch (...) {
+			fail_({}, std::current_exception());
+			return;
+		}
+	}
+}
+
+bool directory_crawler::take_(std::size_t index) {
+	worker & own = *workers_[index];
+	{
+		std::lock_guard<std::mutex> lock{own.mutex};
+		if (!own.queue.empty()) {
+			own.current = std::move(own.queue.back());
+			own.queue.pop_back();
+			--queued_;
+			return true;
+		}
+	}
+
+	// Hold both locks while moving the container, so checkpoint() always sees it in one place.
+	for (std::size_t offset = 1; offset < workers_.size(); ++offset) {
+		worker & victim = *workers_[(index + offset) % workers_.size()];
+		std::scoped_lock<std::mutex, std::mutex> lock{victim.mutex, own.mutex};
+		if (victim.queue.empty()) continue;
+		own.current = std::move(victim.queue.front());
+		victim.queue.pop_front();
+		--queued_;
+		++steals_;
+		return true;
+	}
+	return false;
+}
+
+void directory_crawler::crawl_(std::size_t index, connection_pool::lease & lease, consumer const & consumer, operation_limits const & limits, std::error_code & error) {
+	worker & own = *workers_[index];
+	ldapxx::query query;
+	{
+		std::lock_guard<std::mutex> lock{own.mutex};
+		query.base = *own.current;
+	}
+	query.scope      = scope::one_level;
+	query.attributes = options_.attributes;
+
+	owned_result result = lease.connection().search(query, limits, options_.max_response_size, error);
+	if (error) return;
+	++containers_;
+
+	std::vector<std::string> children;
+	walk_entries(lease.native(), result_t{result.get()}, [&] (entry_t entry) {
+		consumer(lease.native(), entry);
+		++entries_;
+		if (!is_container(lease.native(), entry, options_.descend_unknown)) return;
+		char * dn = ldap_get_dn(lease.native(), entry);
+		if (!dn) return;
+		children.emplace_back(dn);
+		ldap_memfree(dn);
+	});
+
+	// Count the children as pending before the container is finished, so the count never drops to zero too early.
+	pending_ += children.size();
+	{
+		std::lock_guard<std::mutex> lock{own.mutex};
+		queued_ += children.size();
+		for (std::string & child : children) own.queue.push_back(std::move(child));
+		own.current.reset();
+	}
+	bool finished = --pending_ == 0;
+
+	if (children.size() > 1 || finished) wake_();
+}
+
+void directory_crawler::fail_(std::error_code error, std::exception_ptr exception) {
+	{
+		std::lock_guard<std::mutex> lock{error_mutex_};
+		if (!error_ && !exception_) {
+			error_     = error;
+			exception_ = exception;
+		}
+	}
+	stop_ = true;
+	wake_();
+}
+
+void directory_crawler::wake_() {
+	// Take the lock so a worker can not miss the notification between checking its predicate and waiting.
+	{ std::lock_guard<std::mutex> lock{idle_mutex_}; }
+	idle_.notify_all();
+}
+
+}
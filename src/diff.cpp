@@ -0,0 +1,171 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "diff.hpp"
+#include "modification_buffer.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace ldapxx {
+
+namespace {
+	std::string to_lower(std::string_view input) {
+		std::string result{input};
+		for (char & c : result) c = ascii_lower(c);
+		return result;
+	}
+
+	using value_views = std::vector<std::string_view>;
+
+	/// Sort a list of values and remove duplicates.
+	void sort_unique(value_views & values) {
+		std::sort(values.begin(), values.end());
+		values.erase(std::unique(values.begin(), values.end()), values.end());
+	}
+
+	/// Compute the diff given the current values grouped by lowercase attribute name.
+	std::vector<attribute_diff> diff_grouped(
+		std::map<std::string, value_views> & current,
+		std::map<std::string, std::vector<std::string>> const & desired
+	) {
+		std::vector<attribute_diff> result;
+		for (auto const & attribute : desired) {
+			value_views & current_values = current[to_lower(attribute.first)];
+			sort_unique(current_values);
+
+			attribute_diff diff;
+			diff.attribute = attribute.first;
+
+			if (attribute.second.empty()) {
+				if (current_values.empty()) continue;
+				diff.remove_attribute = true;
+				result.push_back(std::move(diff));
+				continue;
+			}
+
+			value_views desired_values(attribute.second.begin(), attribute.second.end());
+			sort_unique(desired_values);
+
+			std::set_difference(
+				desired_values.begin(), desired_values.end(),
+				current_values.begin(), current_values.end(),
+				std::back_inserter(diff.added)
+			);
+			std::set_difference(
+				current_values.begin(), current_values.end(),
+				desired_values.begin(), desired_values.end(),
+				std::back_inserter(diff.removed)
+			);
+
+			if (diff.added.empty() && diff.removed.empty()) continue;
+			result.push_back(std::move(diff));
+		}
+		return result;
+	}
+
+	/// Add values to a buffer in chunks, flushing the buffer whenever it is full.
+	template<typename Flush>
+	bool add_chunked(modification_buffer & buffer, modification_type type, std::string_view attribute, value_views::const_iterator begin, value_views::const_iterator end, std::size_t max_values, Flush && flush) {
+		while (begin != end) {
+			std::size_t space = max_values > buffer.value_count() ? max_values - buffer.value_count() : 0;
+			if (space == 0) {
+				if (!flush()) return false;
+				continue;
+			}
+			std::size_t count = std::min<std::size_t>(space, end - begin);
+			buffer.add(type, attribute, begin, begin + count);
+			begin += count;
+		}
+		return true;
+	}
+}
+
+std::vector<attribute_diff> diff_entry(
+	std::multimap<std::string, std::string> const & current,
+	std::map<std::string, std::vector<std::string>> const & desired
+) {
+	std::map<std::string, value_views> grouped;
+	for (auto const & value : current) grouped[to_lower(value.first)].push_back(value.second);
+	return diff_grouped(grouped, desired);
+}
+
+std::vector<attribute_diff> diff_entry(
+	std::map<std::string, std::vector<std::string>> const & current,
+	std::map<std::string, std::vector<std::string>> const & desired
+) {
+	std::map<std::string, value_views> grouped;
+	for (auto const & attribute : current) {
+		value_views & values = grouped[to_lower(attribute.first)];
+		values.insert(values.end(), attribute.second.begin(), attribute.second.end());
+	}
+	return diff_grouped(grouped, desired);
+}
+
+void apply_entry_diff(connection & connection, std::string const & dn, std::vector<attribute_diff> const & diff, std::size_t max_values) {
+	std::error_code error;
+	apply_entry_diff(connection, dn, diff, max_values, error);
+	if (error) throw ldapxx::error{errc(error.value()), "applying entry diff"};
+}
+
+void apply_entry_diff(connection & connection, std::string const & dn, std::vector<attribute_diff> const & diff, std::size_t max_values, std::error_code & error) {
+	error = {};
+	max_values = std::max<std::size_t>(max_values, 1);
+
+	modification_buffer buffer;
+	auto flush = [&] () {
+		if (buffer.empty()) return true;
+		connection.modify(dn, buffer, error);
+		buffer.clear();
+		return !error;
+	};
+
+	for (attribute_diff const & attribute : diff) {
+		if (attribute.remove_attribute) {
+			buffer.add(modification_type::remove_attribute, attribute.attribute, {});
+			continue;
+		}
+
+		// Keep all changes to an attribute in one request if possible.
+		std::size_t total = attribute.added.size() + attribute.removed.size();
+		if (total <= max_values && buffer.value_count() + total > max_values && !flush()) return;
+
+		// If the changes are split over multiple requests, hold back one removal until after the additions,
+		// so the attribute never runs out of values in between. That would violate the schema for required attributes.
+		value_views const & removed = attribute.removed;
+		value_views const & added   = attribute.added;
+		auto held_back = total > max_values && !added.empty() && !removed.empty() ? removed.end() - 1 : removed.end();
+
+		if (!add_chunked(buffer, modification_type::remove_values, attribute.attribute, removed.begin(), held_back,     max_values, flush)) return;
+		if (!add_chunked(buffer, modification_type::add,           attribute.attribute, added.begin(),   added.end(),   max_values, flush)) return;
+		if (!add_chunked(buffer, modification_type::remove_values, attribute.attribute, held_back,       removed.end(), max_values, flush)) return;
+	}
+
+	flush();
+}
+
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dn.hpp"
+#include "error.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+
+namespace ldapxx {
+
+namespace {
+	bool is_space(char c) { return c == ' '; }
+	bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+	bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+	int hex_value(char c) {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	/// Characters that need to be escaped anywhere in a value.
+	bool is_special(char c) {
+		switch (c) {
+			case '"': case '+': case ',': case ';': case '<': case '>': case '\\':
+				return true;
+		}
+		return false;
+	}
+
+	/// Find the first unescaped occurence of a character in a normalized DN.
+	std::size_t find_unescaped(std::string_view normalized, char wanted, std::size_t start = 0) {
+		for (std::size_t i = start; i < normalized.size(); ++i) {
+			if (normalized[i] == '\\') ++i;
+			else if (normalized[i] == wanted) return i;
+		}
+		return std::string_view::npos;
+	}
+
+	/// Check if the character at the given index in a normalized DN is preceded by an escape.
+	bool is_escaped(std::string_view normalized, std::size_t index) {
+		std::size_t backslashes = 0;
+		while (index > backslashes && normalized[index - backslashes - 1] == '\\') ++backslashes;
+		return backslashes % 2;
+	}
+
+	/// Simple recursive descent parser that writes the normalized DN directly to the output.
+	class dn_parser {
+		std::string_view input_;
+		std::size_t pos_ = 0;
+		std::string & output_;
+
+		bool at_end() const { return pos_ >= input_.size(); }
+		char peek() const { return input_[pos_]; }
+
+		void skip_spaces() {
+			while (!at_end() && is_space(peek())) ++pos_;
+		}
+
+		bool parse_type() {
+			std::size_t start = pos_;
+			if (at_end()) return false;
+			if (is_alpha(peek())) {
+				while (!at_end() && (is_alpha(peek()) || is_digit(peek()) || peek() == '-')) ++pos_;
+			} else if (is_digit(peek())) {
+				while (!at_end() && (is_digit(peek()) || peek() == '.')) ++pos_;
+			}
+			if (pos_ == start) return false;
+			for (std::size_t i = start; i < pos_; ++i) output_.push_back(ascii_lower(input_[i]));
+			return true;
+		}
+
+		bool parse_hex_value() {
+			output_.push_back('#');
+			++pos_;
+			std::size_t start = pos_;
+			while (pos_ + 1 < input_.size() && hex_value(input_[pos_]) >= 0 && hex_value(input_[pos_ + 1]) >= 0) {
+				output_.push_back(ascii_lower(input_[pos_]));
+				output_.push_back(ascii_lower(input_[pos_ + 1]));
+				pos_ += 2;
+			}
+			if (pos_ == start) return false;
+			skip_spaces();
+			return true;
+		}
+
+		/// Read one (possibly escaped) character of a value.
+		/**
+		 * Returns false on invalid escape sequences.
+		 */
+		bool read_char(char & c) {
+			c = input_[pos_++];
+			if (c != '\\') return true;
+			if (at_end()) return false;
+
+			char next = input_[pos_++];
+			int high = hex_value(next);
+			if (high >= 0 && !at_end() && hex_value(peek()) >= 0) {
+				c = char(high << 4 | hex_value(input_[pos_++]));
+				return true;
+			}
+			if (is_special(next) || next == ' ' || next == '#' || next == '=') {
+				c = next;
+				return true;
+			}
+			return false;
+		}
+
+		void write_char(char c, bool first) {
+			if (c == '\0') {
+				output_.append("\\00");
+			} else if (is_special(c) || (first && c == '#')) {
+				output_.push_back('\\');
+				output_.push_back(c);
+			} else {
+				output_.push_back(ascii_lower(c));
+			}
+		}
+
+		bool parse_string_value() {
+			bool quoted = !at_end() && peek() == '"';
+			if (quoted) ++pos_;
+
+			bool first          = true;
+			bool pending_space  = false;
+			while (!at_end()) {
+				char c = peek();
+				if (quoted && c == '"') break;
+				if (!quoted && (c == ',' || c == ';' || c == '+')) break;
+				if (!quoted && (c == '"' || c == '<' || c == '>')) return false;
+
+				if (!read_char(c)) return false;
+
+				if (c == ' ') {
+					pending_space = !first;
+					continue;
+				}
+
+				if (pending_space) output_.push_back(' ');
+				pending_space = false;
+				write_char(c, first);
+				first = false;
+			}
+
+			if (quoted) {
+				if (at_end()) return false;
+				++pos_;
+				skip_spaces();
+			}
+			return true;
+		}
+
+		bool parse_value() {
+			if (!at_end() && peek() == '#') return parse_hex_value();
+			return parse_string_value();
+		}
+
+		bool parse_ava() {
+			skip_spaces();
+			if (!parse_type()) return false;
+			skip_spaces();
+			if (at_end() || peek() != '=') return false;
+			++pos_;
+			output_.push_back('=');
+			skip_spaces();
+			return parse_value();
+		}
+
+		/// Sort the attribute value assertions of the RDN starting at the given offset in the output.
+		/**
+		 * Multi-valued RDNs are rare and small, so a bubble sort of adjacent segments is good enough.
+		 * It works entirely in place, so it doesn't need any memory.
+		 */
+		void sort_rdn(std::size_t rdn_start) {
+			std::string_view rdn = std::string_view{output_}.substr(rdn_start);
+			if (find_unescaped(rdn, '+') == std::string_view::npos) return;
+
+			bool swapped = true;
+			while (swapped) {
+				swapped = false;
+				std::size_t start = rdn_start;
+				while (true) {
+					std::string_view tail = std::string_view{output_}.substr(start);
+					std::size_t split = find_unescaped(tail, '+');
+					if (split == std::string_view::npos) break;
+					std::size_t end = find_unescaped(tail, '+', split + 1);
+					if (end == std::string_view::npos) end = tail.size();
+
+					std::string_view a = tail.substr(0, split);
+					std::string_view b = tail.substr(split + 1, end - split - 1);
+					if (b < a) {
+						std::size_t a_size = a.size();
+						std::size_t b_size = b.size();
+						auto begin = output_.begin() + start;
+						std::rotate(begin, begin + a_size + 1, begin + end);
+						std::rotate(begin + b_size, begin + b_size + a_size, begin + end);
+						swapped = true;
+						start += b_size + 1;
+					} else {
+						start += split + 1;
+					}
+				}
+			}
+		}
+
+	public:
+		dn_parser(std::string_view input, std::string & output) : input_{input}, output_{output} {}
+
+		bool parse() {
+			skip_spaces();
+			if (at_end()) return true;
+
+			while (true) {
+				std::size_t rdn_start = output_.size();
+				while (true) {
+					if (!parse_ava()) return false;
+					if (at_end() || peek() != '+') break;
+					output_.push_back('+');
+					++pos_;
+				}
+				sort_rdn(rdn_start);
+
+				if (at_end()) return true;
+				if (peek() != ',' && peek() != ';') return false;
+				output_.push_back(',');
+				++pos_;
+			}
+		}
+	};
+}
+
+bool normalize_dn(std::string_view input, std::string & output) {
+	std::size_t original_size = output.size();
+	if (dn_parser{input, output}.parse()) return true;
+	output.resize(original_size);
+	return false;
+}
+
+std::string_view dn_parent(std::string_view normalized) {
+	std::size_t separator = find_unescaped(normalized, ',');
+	if (separator == std::string_view::npos) return {};
+	return normalized.substr(separator + 1);
+}
+
+std::string_view dn_rdn(std::string_view normalized) {
+	return normalized.substr(0, find_unescaped(normalized, ','));
+}
+
+std::size_t dn_depth(std::string_view normalized) {
+	if (normalized.empty()) return 0;
+	std::size_t depth = 1;
+	for (std::size_t i = find_unescaped(normalized, ','); i != std::string_view::npos; i = find_unescaped(normalized, ',', i + 1)) {
+		++depth;
+	}
+	return depth;
+}
+
+bool dn_is_ancestor(std::string_view ancestor, std::string_view descendant) {
+	if (ancestor.empty()) return !descendant.empty();
+	if (descendant.size() <= ancestor.size() + 1) return false;
+	if (descendant.substr(descendant.size() - ancestor.size()) != ancestor) return false;
+	std::size_t separator = descendant.size() - ancestor.size() - 1;
+	return descendant[separator] == ',' && !is_escaped(descendant, separator);
+}
+
+bool dn_is_parent(std::string_view parent, std::string_view child) {
+	if (child.empty()) return false;
+	return dn_parent(child) == parent;
+}
+
+dn::dn(std::string normalized, normalized_tag) :
+	normalized_{std::move(normalized)},
+	hash_{hash_dn(normalized_)} {}
+
+dn::dn() : dn{std::string{}, normalized_tag{}} {}
+
+dn::dn(std::string_view input) {
+	if (!normalize_dn(input, normalized_)) throw error{errc::invalid_dn_syntax, "parsing DN"};
+	hash_ = hash_dn(normalized_);
+}
+
+boost::optional<dn> dn::parse(std::string_view input) {
+	std::string normalized;
+	if (!normalize_dn(input, normalized)) return boost::none;
+	return dn{std::move(normalized), normalized_tag{}};
+}
+
+dn dn::parent() const {
+	return dn{std::string{dn_parent(normalized_)}, normalized_tag{}};
+}
+
+bool in_scope(dn const & base, ldapxx::scope scope, dn const & entry) {
+	switch (scope) {
+		case ldapxx::scope::base:      return entry == base;
+		case ldapxx::scope::one_level: return base.is_parent_of(entry);
+		case ldapxx::scope::subtree:   return entry == base || base.is_ancestor_of(entry);
+		case ldapxx::scope::children:  return base.is_ancestor_of(entry);
+	}
+	return false;
+}
+
+}
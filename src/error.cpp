@@ -11,6 +11,8 @@ struct ldap_category : std::error_category {
 			case errc::protocol_error                 : return "protocol error";
 			case errc::time_limit_exceeded            : return "time limit exceeded";
 			case errc::size_limit_exceeded            : return "size limit exceeded";
+			case errc::compare_false                  : return "compare false";
+			case errc::compare_true                   : return "compare true";
 			case errc::auth_method_not_supported      : return "auth method not supported";
 			case errc::stronger_auth_required         : return "stronger auth required";
 			case errc::referral                       : return "referral";
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "escape.hpp"
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace ldapxx {
+
+namespace {
+	/// Find the first occurence of any of the given bytes.
+	/**
+	 * Uses AVX2 or SSE2 to check 32 or 16 bytes at a time if available,
+	 * and falls back to a simple loop for the remaining bytes.
+	 */
+	template<char... Specials>
+	std::size_t find_any(std::string_view input) {
+		char const * data = input.data();
+		std::size_t size  = input.size();
+		std::size_t i     = 0;
+
+#if defined(__AVX2__)
+		for (; i + 32 <= size; i += 32) {
+			__m256i chunk = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i));
+			__m256i match = _mm256_setzero_si256();
+			((match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(Specials)))), ...);
+			unsigned int mask = _mm256_movemask_epi8(match);
+			if (mask) return i + __builtin_ctz(mask);
+		}
+#endif
+
+#if defined(__SSE2__)
+		for (; i + 16 <= size; i += 16) {
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i));
+			__m128i match = _mm_setzero_si128();
+			((match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(Specials)))), ...);
+			unsigned int mask = _mm_movemask_epi8(match);
+			if (mask) return i + __builtin_ctz(mask);
+		}
+#endif
+
+		for (; i < size; ++i) {
+			char c = data[i];
+			if (((c == Specials) || ...)) return i;
+		}
+
+		return std::string_view::npos;
+	}
+
+	char hex_digit(unsigned int value) {
+		return "0123456789abcdef"[value & 0xf];
+	}
+
+	void append_hex_escape(std::string & output, char c) {
+		output.push_back('\\');
+		output.push_back(hex_digit((unsigned char)(c) >> 4));
+		output.push_back(hex_digit((unsigned char)(c)));
+	}
+}
+
+std::size_t find_filter_special(std::string_view input) {
+	return find_any<'*', '(', ')', '\\', '\0'>(input);
+}
+
+std::size_t find_dn_special(std::string_view input) {
+	return find_any<'"', '+', ',', ';', '<', '>', '\\', '\0'>(input);
+}
+
+std::string_view escape_filter_value(std::string_view input, std::string & buffer) {
+	std::size_t special = find_filter_special(input);
+	if (special == std::string_view::npos) return input;
+
+	buffer.clear();
+	buffer.reserve(input.size() + 16);
+	while (special != std::string_view::npos) {
+		buffer.append(input.data(), special);
+		append_hex_escape(buffer, input[special]);
+		input.remove_prefix(special + 1);
+		special = find_filter_special(input);
+	}
+	buffer.append(input.data(), input.size());
+	return buffer;
+}
+
+std::string_view escape_dn_value(std::string_view input, std::string & buffer) {
+	bool leading  = !input.empty() && (input.front() == '#' || input.front() == ' ');
+	bool trailing = input.size() > 1 && input.back() == ' ';
+	std::size_t special = find_dn_special(input);
+	if (!leading && !trailing && special == std::string_view::npos) return input;
+
+	buffer.clear();
+	buffer.reserve(input.size() + 16);
+
+	// Leading and trailing characters need escaping only because of their position.
+	if (leading) {
+		buffer.push_back('\\');
+		buffer.push_back(input.front());
+		input.remove_prefix(1);
+		special = find_dn_special(input);
+	}
+	if (trailing) {
+		input.remove_suffix(1);
+		if (special >= input.size()) special = std::string_view::npos;
+	}
+
+	while (special != std::string_view::npos) {
+		buffer.append(input.data(), special);
+		if (input[special] == '\0') {
+			buffer.append("\\00");
+		} else {
+			buffer.push_back('\\');
+			buffer.push_back(input[special]);
+		}
+		input.remove_prefix(special + 1);
+		special = find_dn_special(input);
+	}
+	buffer.append(input.data(), input.size());
+
+	if (trailing) buffer.append("\\ ");
+	return buffer;
+}
+
+}
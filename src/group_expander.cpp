@@ -0,0 +1,202 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "group_expander.hpp"
+#include "dn.hpp"
+#include "escape.hpp"
+#include "walk_result.hpp"
+
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+
+namespace ldapxx {
+
+namespace {
+	/// Get a key to compare DNs, falling back to the DN itself if it can not be parsed.
+	std::string dn_key(std::string_view dn) {
+		std::string result;
+		if (!normalize_dn(dn, result)) result = std::string{dn};
+		return result;
+	}
+}
+
+group_expander::group_expander(ldapxx::connection connection, group_expander_options options) :
+	connection_{connection},
+	options_{std::move(options)}
+{
+	options_.max_in_flight = std::max<std::size_t>(options_.max_in_flight, 1);
+}
+
+std::vector<std::string> group_expander::effective_groups(std::string const & dn, operation_limits const & limits) {
+	std::error_code error;
+	std::vector<std::string> result = effective_groups(dn, limits, error);
+	throw_if(error, "expanding nested groups");
+	return result;
+}
+
+std::vector<std::string> group_expander::effective_groups(std::string const & dn, operation_limits const & limits, std::error_code & error) {
+	error = {};
+	std::vector<std::string> result;
+	std::unordered_set<std::string> visited{dn_key(dn)};
+
+	std::vector<std::string> level{dn};
+	std::vector<std::vector<std::string>> groups;
+	for (std::size_t depth = 0; !level.empty() && depth < options_.max_depth; ++depth) {
+		direct_groups_(level, groups, limits, error);
+		if (error) return {};
+
+		std::vector<std::string> next;
+		for (std::vector<std::string> const & list : groups) {
+			for (std::string const & group : list) {
+				if (!visited.insert(dn_key(group)).second) {
+					++stats_.cycles;
+					continue;
+				}
+				result.push_back(group);
+				next.push_back(group);
+			}
+		}
+		level = std::move(next);
+	}
+
+	return result;
+}
+
+void group_expander::invalidate(std::string_view dn) {
+	auto found = cache_.find(dn_key(dn));
+	if (found != cache_.end()) forget_(found);
+}
+
+void group_expander::direct_groups_(std::vector<std::string> const & dns, std::vector<std::vector<std::string>> & output, operation_limits const & limits, std::error_code & error) {
+	clock::time_point now = clock::now();
+	output.assign(dns.size(), {});
+
+	// Answer what we can from the cache.
+	std::vector<std::size_t> missing;
+	std::vector<std::string> keys;
+	keys.reserve(dns.size());
+	for (std::size_t i = 0; i < dns.size(); ++i) {
+		keys.push_back(dn_key(dns[i]));
+		auto found = cache_.find(keys.back());
+		if (found != cache_.end() && found->second.expires > now) {
+			output[i] = found->second.groups;
+			++stats_.cache_hits;
+		} else {
+			missing.push_back(i);
+		}
+	}
+	if (missing.empty()) return;
+	++stats_.round_trips;
+
+	std::string escape_buffer;
+	ldapxx::query query;
+	query.base       = options_.base;
+	query.scope      = scope::subtree;
+	query.attributes = {LDAP_NO_ATTRS};
+
+	// Pipeline the lookups in windows, so that no more than max_in_flight are outstanding.
+	std::vector<int> in_flight;
+	auto abandon_in_flight = [&] () {
+		for (int message_id : in_flight) ldap_abandon_ext(connection_, message_id, nullptr, nullptr);
+		in_flight.clear();
+	};
+
+	for (std::size_t begin = 0; begin < missing.size(); begin += options_.max_in_flight) {
+		std::size_t end = std::min(missing.size(), begin + options_.max_in_flight);
+
+		if (limits.remaining().count() == 0) {
+			error = errc::timeout;
+			return;
+		}
+
+		for (std::size_t i = begin; i < end; ++i) {
+			std::string_view value = escape_filter_value(dns[missing[i]], escape_buffer);
+			query.filter = "(" + options_.member_attribute + "=" + std::string{value} + ")";
+			if (!options_.group_filter.empty()) query.filter = "(&" + options_.group_filter + query.filter + ")";
+
+			int message_id = connection_.search_async(query, limits.time_limit(), default_max_response_size, nullptr, error);
+			if (error) {
+				abandon_in_flight();
+				return;
+			}
+			in_flight.push_back(message_id);
+			++stats_.lookups;
+		}
+
+		for (std::size_t i = begin; i < end; ++i) {
+			owned_result result = connection_.wait_result(in_flight[i - begin], limits, error);
+			if (!error) {
+				errc code = result_code(connection_, result, error);
+				if (!error && code != errc::success) error = code;
+			}
+			if (error) {
+				in_flight.erase(in_flight.begin(), in_flight.begin() + (i - begin + 1));
+				abandon_in_flight();
+				return;
+			}
+
+			std::vector<std::string> & groups = output[missing[i]];
+			walk_entries(connection_, result_t{result.get()}, [&] (entry_t entry) {
+				char * group = ldap_get_dn(connection_, entry);
+				if (!group) return;
+				groups.emplace_back(group);
+				ldap_memfree(group);
+			});
+			remember_(keys[missing[i]], groups, now);
+		}
+		in_flight.clear();
+	}
+}
+
+void group_expander::forget_(std::unordered_map<std::string, cache_entry>::iterator entry) {
+	expiry_.erase(entry->second.expiry);
+	cache_.erase(entry);
+}
+
+void group_expander::remember_(std::string key, std::vector<std::string> groups, clock::time_point now) {
+	if (options_.max_cache_size == 0) return;
+
+	auto found = cache_.find(key);
+	if (found != cache_.end()) {
+		found->second.groups  = std::move(groups);
+		found->second.expires = now + options_.ttl;
+		expiry_.splice(expiry_.end(), expiry_, found->second.expiry);
+		return;
+	}
+
+	// Drop expired entries, and the ones closest to expiring while the cache is full.
+	while (!expiry_.empty()) {
+		auto oldest = cache_.find(*expiry_.front());
+		if (oldest->second.expires > now && cache_.size() < options_.max_cache_size) break;
+		forget_(oldest);
+	}
+
+	auto inserted = cache_.emplace(std::move(key), cache_entry{std::move(groups), now + options_.ttl, {}}).first;
+	inserted->second.expiry = expiry_.insert(expiry_.end(), &inserted->first);
+}
+
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "hedged_search.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <array>
+#include <climits>
+
+namespace ldapxx {
+
+namespace {
+	using clock = std::chrono::steady_clock;
+
+	/// A search request sent to one replica.
+	struct attempt {
+		connection_pool::lease lease;
+		int message_id = -1;
+		clock::time_point sent;
+		bool active = false;
+	};
+
+	/// Send a search to a replica.
+	/**
+	 * If wait is false, the search is only sent if the pool has a connection available without waiting.
+	 * Otherwise the attempt is left inactive, without reporting an error.
+	 */
+	void start(attempt & attempt, connection_pool & pool, query const & query, operation_limits const & limits, std::size_t max_response, bool wait, std::error_code & error) {
+		std::chrono::milliseconds remaining = limits.remaining();
+		if (remaining.count() == 0) {
+			error = errc::timeout;
+			return;
+		}
+
+		// Without a deadline, remaining() is milliseconds::max(), for which the pool waits without limit.
+		try {
+			attempt.lease = wait ? pool.acquire(remaining) : pool.try_acquire();
+		} catch (ldapxx::error const & e) {
+			error = e.code();
+			return;
+		}
+		if (!attempt.lease) {
+			if (wait) error = errc::timeout;
+			return;
+		}
+
+		attempt.message_id = attempt.lease.connection().search_async(query, limits.time_limit(), max_response, nullptr, error);
+		if (error) {
+			attempt.lease.discard();
+			return;
+		}
+		attempt.sent   = clock::now();
+		attempt.active = true;
+	}
+
+	/// Check for the complete response of a search without blocking.
+	/**
+	 * On error, the attempt is finished and the connection discarded.
+	 */
+	owned_result poll_response(attempt & attempt, std::error_code & error) {
+		timeval zero{0, 0};
+		LDAPMessage * result = nullptr;
+		int type = ldap_result(attempt.lease, attempt.message_id, LDAP_MSG_ALL, &zero, &result);
+		owned_result safe_result{result};
+		if (type == -1) {
+			error = last_result_code(attempt.lease);
+			attempt.active = false;
+			attempt.lease.discard();
+		} else if (type > 0) {
+			attempt.active = false;
+		}
+		return safe_result;
+	}
+
+	/// Abandon a search that is still in progress.
+	void abandon(attempt & attempt) {
+		if (!attempt.active) return;
+		ldap_abandon_ext(attempt.lease, attempt.message_id, nullptr, nullptr);
+		attempt.active = false;
+	}
+
+	/// Wait until one of the active attempts has data to read, or until a wake up time.
+	void wait_readable(std::array<attempt, 2> const & attempts, clock::time_point wake_up) {
+		std::array<pollfd, 2> fds;
+		nfds_t count = 0;
+		for (attempt const & attempt : attempts) {
+			if (!attempt.active) continue;
+			int fd = -1;
+			ldap_get_option(attempt.lease, LDAP_OPT_DESC, &fd);
+			if (fd < 0) continue;
+			fds[count++] = pollfd{fd, POLLIN, 0};
+		}
+
+		auto timeout = std::chrono::ceil<std::chrono::milliseconds>(wake_up - clock::now());
+		int timeout_ms = int(std::clamp<std::chrono::milliseconds::rep>(timeout.count(), 0, INT_MAX));
+		poll(fds.data(), count, timeout_ms);
+	}
+}
+
+hedged_searcher::hedged_searcher(std::vector<connection_pool *> replicas, hedging_options options) :
+	replicas_{std::move(replicas)},
+	options_{options} {}
+
+std::chrono::milliseconds hedged_searcher::hedge_delay() const {
+	if (latency_.count() < options_.min_samples) return options_.initial_delay;
+	auto delay = std::chrono::ceil<std::chrono::milliseconds>(latency_.percentile(options_.percentile));
+	return std::clamp(delay, options_.min_delay, options_.max_delay);
+}
+
+hedging_stats hedged_searcher::stats() const {
+	hedging_stats result;
+	result.searches = searches_.load(std::memory_order_relaxed);
+	result.hedged   = hedged_.load(std::memory_order_relaxed);
+	result.won      = won_.load(std::memory_order_relaxed);
+	return result;
+}
+
+owned_result hedged_searcher::search(query const & query, operation_limits const & limits, std::size_t max_response_size) {
+	std::error_code error;
+	owned_result result = search(query, limits, max_response_size, error);
+	if (error) throw ldapxx::error{errc(error.value()), "performing hedged LDAP search"};
+	return result;
+}
+
+owned_result hedged_searcher::search(query const & query, operation_limits const & limits, std::size_t max_response_size, std::error_code & error) {
+	error = {};
+	if (replicas_.empty()) {
+		error = errc::param_error;
+		return nullptr;
+	}
+	searches_.fetch_add(1, std::memory_order_relaxed);
+
+	std::size_t first = next_.fetch_add(1, std::memory_order_relaxed) % replicas_.size();
+	std::array<attempt, 2> attempts;
+	auto abandon_all = at_scope_exit([&] () {
+		for (attempt & attempt : attempts) abandon(attempt);
+	});
+
+	start(attempts[0], *replicas_[first], query, limits, max_response_size, true, error);
+	if (error) return nullptr;
+
+	bool can_hedge = replicas_.size() > 1;
+	clock::time_point hedge_at = attempts[0].sent + hedge_delay();
+
+	// A hedge must never delay the first attempt, so it is skipped if the other replica has no connection available.
+	std::error_code hedge_error;
+	auto hedge = [&] () {
+		can_hedge = false;
+		start(attempts[1], *replicas_[(first + 1) % replicas_.size()], query, limits, max_response_size, false, hedge_error);
+		if (attempts[1].active) hedged_.fetch_add(1, std::memory_order_relaxed);
+	};
+
+	while (true) {
+		for (std::size_t i = 0; i < attempts.size(); ++i) {
+			if (!attempts[i].active) continue;
+			owned_result result = poll_response(attempts[i], error);
+
+			if (error) {
+				// Fail over to the other replica immediately if we still can.
+				if (can_hedge) hedge();
+				if (attempts[0].active || attempts[1].active) {
+					error = {};
+					continue;
+				}
+
+				// If the fail over could not be sent, report why.
+				if (hedge_error) error = hedge_error;
+				return nullptr;
+			}
+			if (!result) continue;
+
+			// If the second replica won, the latency of the first is at least this long.
+			latency_.record(std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - attempts[0].sent));
+			if (i == 1) won_.fetch_add(1, std::memory_order_relaxed);
+
+			errc code = result_code(attempts[i].lease, result, error);
+			if (!error && code != errc::success) error = code;
+			return result;
+		}
+
+		if (limits.cancelled()) {
+			error = errc::user_cancelled;
+			return nullptr;
+		}
+
+		clock::time_point now = clock::now();
+		if (now >= limits.deadline) {
+			error = errc::timeout;
+			return nullptr;
+		}
+
+		if (can_hedge && now >= hedge_at) {
+			hedge();
+			continue;
+		}
+
+		clock::time_point wake_up = limits.deadline;
+		if (can_hedge) wake_up = std::min(wake_up, hedge_at);
+		if (limits.cancel) wake_up = std::min(wake_up, now + limits.poll_interval);
+		wait_readable(attempts, wake_up);
+	}
+}
+
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "interning.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace ldapxx {
+
+namespace {
+	/// Size of the blocks values are stored in.
+	constexpr std::size_t block_size = 64 * 1024;
+}
+
+std::uint32_t attribute_interner::intern(std::string_view name) {
+	std::uint32_t id = index_.insert(name, std::uint32_t(names_.size()));
+	if (id == names_.size()) names_.emplace_back(name);
+	return id;
+}
+
+boost::optional<std::uint32_t> attribute_interner::find(std::string_view name) const {
+	std::uint32_t id = index_.find(name);
+	if (id == no_id) return boost::none;
+	return id;
+}
+
+std::string_view value_pool::store_(std::string_view value) {
+	bytes_ += value.size();
+
+	// Large values get a block of their own, so they don't waste the rest of the current block.
+	if (value.size() > block_size / 4) {
+		blocks_.push_back(std::unique_ptr<char[]>(new char[value.size()]));
+		std::memcpy(blocks_.back().get(), value.data(), value.size());
+		return {blocks_.back().get(), value.size()};
+	}
+
+	if (free_ < value.size()) {
+		blocks_.push_back(std::unique_ptr<char[]>(new char[block_size]));
+		block_ = blocks_.back().get();
+		used_  = 0;
+		free_  = block_size;
+	}
+
+	char * data = block_ + used_;
+	std::memcpy(data, value.data(), value.size());
+	used_ += value.size();
+	free_ -= value.size();
+	return {data, value.size()};
+}
+
+void value_pool::grow_() {
+	std::vector<std::string_view> old = std::exchange(slots_, std::vector<std::string_view>(std::max<std::size_t>(64, slots_.size() * 2)));
+	std::size_t mask = slots_.size() - 1;
+	for (std::string_view value : old) {
+		if (!value.data()) continue;
+		std::size_t index = std::hash<std::string_view>{}(value) & mask;
+		while (slots_[index].data()) index = (index + 1) & mask;
+		slots_[index] = value;
+	}
+}
+
+std::string_view value_pool::intern(std::string_view value) {
+	// Empty slots are marked by a null view, so empty values must not end up in the table.
+	if (value.empty()) return std::string_view{"", 0};
+	if (!options_.deduplicate || value.size() > options_.max_deduplicated_size) return store_(value);
+
+	if ((unique_ + 1) * 2 > slots_.size()) grow_();
+
+	std::size_t mask = slots_.size() - 1;
+	std::size_t index = std::hash<std::string_view>{}(value) & mask;
+	for (; slots_[index].data(); index = (index + 1) & mask) {
+		if (slots_[index] == value) {
+			++hits_;
+			return slots_[index];
+		}
+	}
+
+	slots_[index] = store_(value);
+	++unique_;
+	return slots_[index];
+}
+
+void value_pool::clear() {
+	blocks_.clear();
+	block_  = nullptr;
+	used_   = 0;
+	free_   = 0;
+	bytes_  = 0;
+	slots_.clear();
+	unique_ = 0;
+	hits_   = 0;
+}
+
+void collect_attributes(std::vector<std::uint32_t> & output, attribute_interner & names, LDAP * connection, entry_t entry) {
+	walk_attributes(connection, entry, [&] (char const * attribute) {
+		output.push_back(names.intern(attribute));
+	});
+}
+
+std::vector<std::uint32_t> collect_attribute_ids(attribute_interner & names, LDAP * connection, entry_t entry) {
+	std::vector<std::uint32_t> output;
+	collect_attributes(output, names, connection, entry);
+	return output;
+}
+
+std::vector<interned_value> entry_to_interned(attribute_interner & names, value_pool & values, LDAP * connection, entry_t entry) {
+	std::vector<interned_value> output;
+	walk_attributes(connection, entry, [&] (char const * attribute) {
+		// ldap_get_values_len() copies the values out of the result, and the pool copies them again, so free the list right away.
+		berval * * list = ldap_get_values_len(connection, entry, attribute);
+		if (!list) return;
+		auto free_list = at_scope_exit([list] () { ldap_value_free_len(list); });
+
+		std::uint32_t id = names.intern(attribute);
+		int count = ldap_count_values_len(list);
+		for (int i = 0; i < count; ++i) {
+			output.emplace_back(id, values.intern(std::string_view{list[i]->bv_val, list[i]->bv_len}));
+		}
+	});
+
+	std::stable_sort(output.begin(), output.end(), [] (interned_value const & a, interned_value const & b) {
+		return a.first < b.first;
+	});
+	return output;
+}
+
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "latency_histogram.hpp"
+
+#include <cmath>
+
+namespace ldapxx {
+
+std::size_t latency_histogram::bucket_index_(std::chrono::microseconds latency) {
+	if (latency.count() <= 1) return 0;
+	std::size_t index = std::size_t(std::log2(double(latency.count())) * 4.0) + 1;
+	return index < bucket_count ? index : bucket_count - 1;
+}
+
+std::chrono::microseconds latency_histogram::bucket_upper_bound_(std::size_t index) {
+	if (index == 0) return std::chrono::microseconds{1};
+	return std::chrono::microseconds{std::int64_t(std::ceil(std::exp2(double(index) / 4.0)))};
+}
+
+void latency_histogram::record(std::chrono::microseconds latency) {
+	buckets_[bucket_index_(latency)].fetch_add(1, std::memory_order_relaxed);
+	if (total_.fetch_add(1, std::memory_order_relaxed) + 1 < window_) return;
+
+	// Halve all counts. Concurrent updates may be counted slightly wrong, which is fine for an estimate.
+	std::uint64_t total = 0;
+	for (auto & bucket : buckets_) {
+		std::uint64_t halved = bucket.load(std::memory_order_relaxed) / 2;
+		bucket.store(halved, std::memory_order_relaxed);
+		total += halved;
+	}
+	total_.store(total, std::memory_order_relaxed);
+}
+
+std::chrono::microseconds latency_histogram::percentile(double fraction) const {
+	std::uint64_t total = 0;
+	std::array<std::uint64_t, bucket_count> counts;
+	for (std::size_t i = 0; i < bucket_count; ++i) {
+		counts[i] = buckets_[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+	if (total == 0) return std::chrono::microseconds{0};
+
+	std::uint64_t target = std::uint64_t(std::ceil(fraction * double(total)));
+	if (target == 0) target = 1;
+	std::uint64_t seen = 0;
+	for (std::size_t i = 0; i < bucket_count; ++i) {
+		seen += counts[i];
+		if (seen >= target) return bucket_upper_bound_(i);
+	}
+	return bucket_upper_bound_(bucket_count - 1);
+}
+
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "load_balancer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace ldapxx {
+
+namespace {
+	/// Check if an error means the server should not be used for a while.
+	bool should_eject(std::error_code const & error) {
+		if (!error || error.category() != ldap_category()) return false;
+		errc code = errc(error.value());
+		return code == errc::server_down || code == errc::connect_error || code == errc::busy || code == errc::unavailable;
+	}
+
+	/// Check if an error means the connection can not be used anymore.
+	bool connection_broken(std::error_code const & error) {
+		if (!error || error.category() != ldap_category()) return false;
+		errc code = errc(error.value());
+		return code == errc::server_down || code == errc::connect_error || code == errc::timeout || code == errc::user_cancelled;
+	}
+}
+
+void load_balancer::lease::complete(std::error_code const & error) {
+	if (!balancer_) return;
+	if (connection_broken(error)) lease_.discard();
+	else lease_.reset();
+	permit_.complete(error);
+	balancer_->complete_(server_, started_, error, true);
+	balancer_ = nullptr;
+}
+
+load_balancer::load_balancer(
+	std::vector<std::string> const & uris,
+	connection_options const & connection_options,
+	boost::optional<bind_credentials> service,
+	load_balancer_options options
+) :
+	options_{options}
+{
+	servers_.reserve(uris.size());
+	for (std::string const & uri : uris) {
+		server server;
+		server.uri  = uri;
+		server.pool = std::make_unique<connection_pool>(uri, connection_options, options_.pool_size, service);
+		if (options_.concurrency) server.limiter = std::make_unique<concurrency_limiter>(*options_.concurrency);
+		servers_.push_back(std::move(server));
+	}
+}
+
+std::size_t load_balancer::pick_(concurrency_limiter::permit & permit) {
+	std::lock_guard<std::mutex> lock{mutex_};
+	clock::time_point now = clock::now();
+
+	std::size_t best = servers_.size();
+	double best_score = 0;
+	for (std::size_t offset = 0; offset < servers_.size(); ++offset) {
+		// Start at a rotating offset so that ties are broken round-robin.
+		std::size_t index = (next_ + offset) % servers_.size();
+		server const & server = servers_[index];
+		if (now < server.ejected_until) continue;
+		if (server.probing && server.outstanding > 0) continue;
+		if (server.limiter && !server.limiter->available()) continue;
+
+		double score = double(server.outstanding);
+		if (options_.strategy == balancing_strategy::ewma) score = server.average_us * double(server.outstanding + 1);
+
+		if (best == servers_.size() || score < best_score) {
+			best       = index;
+			best_score = score;
+		}
+	}
+
+	// Everything is ejected, so use the server that was ejected first.
+	if (best == servers_.size()) {
+		auto earliest = servers_.end();
+		for (auto i = servers_.begin(); i != servers_.end(); ++i) {
+			if (i->limiter && !i->limiter->available()) continue;
+			if (earliest == servers_.end() || i->ejected_until < earliest->ejected_until) earliest = i;
+		}
+		if (earliest == servers_.end()) return servers_.size();
+		best = earliest - servers_.begin();
+	}
+
+	if (servers_[best].limiter) {
+		permit = servers_[best].limiter->try_acquire();
+		if (!permit) return servers_.size();
+	}
+
+	++next_;
+	++servers_[best].outstanding;
+	return best;
+}
+
+void load_balancer::complete_(std::size_t index, clock::time_point started, std::error_code const & error, bool record_latency) {
+	clock::time_point now = clock::now();
+	std::lock_guard<std::mutex> lock{mutex_};
+	server & server = servers_[index];
+	--server.outstanding;
+
+	if (should_eject(error)) {
+		server.failures = std::min(server.failures + 1, 16u);
+		auto backoff = std::min(options_.initial_backoff * (1 << (server.failures - 1)), options_.max_backoff);
+		server.ejected_until = now + backoff;
+		server.probing       = true;
+		return;
+	}
+
+	server.failures = 0;
+	server.probing  = false;
+	if (!record_latency) return;
+
+	double sample = double(std::chrono::duration_cast<std::chrono::microseconds>(now - started).count());
+	if (!server.has_average) server.average_us = sample;
+	else server.average_us += options_.ewma_weight * (sample - server.average_us);
+	server.has_average = true;
+}
+
+load_balancer::lease load_balancer::acquire(std::chrono::milliseconds timeout) {
+	std::error_code error;
+	lease result = acquire(timeout, error);
+	if (error) throw ldapxx::error{errc(error.value()), "acquiring load balanced connection"};
+	return result;
+}
+
+load_balancer::lease load_balancer::acquire(std::chrono::milliseconds timeout, std::error_code & error) {
+	error = {};
+	if (servers_.empty()) {
+		error = errc::param_error;
+		return {};
+	}
+
+	concurrency_limiter::permit permit;
+	std::size_t index = pick_(permit);
+	if (index == servers_.size()) {
+		error = errc::busy;
+		return {};
+	}
+
+	connection_pool::lease pooled;
+	try {
+		pooled = servers_[index].pool->acquire(timeout);
+	} catch (ldapxx::error const & e) {
+		error = e.code();
+		complete_(index, clock::now(), error, false);
+		return {};
+	}
+
+	// An exhausted pool says nothing about the health of the server.
+	if (!pooled) {
+		complete_(index, clock::now(), {}, false);
+		error = errc::timeout;
+		return {};
+	}
+
+	lease result;
+	result.balancer_ = this;
+	result.server_   = index;
+	result.started_  = clock::now();
+	result.lease_    = std::move(pooled);
+	result.permit_   = std::move(permit);
+	return result;
+}
+
+owned_result load_balancer::search(query const & query, operation_limits const & limits, std::size_t max_response_size) {
+	std::error_code error;
+	owned_result result = search(query, limits, max_response_size, error);
+	if (error) throw ldapxx::error{errc(error.value()), "performing load balanced LDAP search"};
+	return result;
+}
+
+owned_result load_balancer::search(query const & query, operation_limits const & limits, std::size_t max_response_size, std::error_code & error) {
+	std::chrono::milliseconds remaining = limits.remaining();
+	if (remaining.count() == 0) {
+		error = errc::timeout;
+		return nullptr;
+	}
+
+	// Without a deadline, remaining() is milliseconds::max(), for which the pool waits without limit.
+	lease lease = acquire(remaining, error);
+	if (error) return nullptr;
+	owned_result result = lease.connection().search(query, limits, max_response_size, error);
+	lease.complete(error);
+	return result;
+}
+
+std::vector<server_status> load_balancer::status() {
+	clock::time_point now = clock::now();
+	std::lock_guard<std::mutex> lock{mutex_};
+
+	std::vector<server_status> result;
+	result.reserve(servers_.size());
+	for (server const & server : servers_) {
+		result.push_back({
+			server.uri,
+			server.outstanding,
+			server.limiter ? server.limiter->stats().limit : 0.0,
+			std::chrono::microseconds{std::int64_t(server.average_us)},
+			now < server.ejected_until,
+			server.failures,
+		});
+	}
+	return result;
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "modification_buffer.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace ldapxx {
+
+namespace {
+	int to_ldap_mod_op(modification_type type) {
+		switch (type) {
+			case modification_type::add:              return LDAP_MOD_ADD | LDAP_MOD_BVALUES;
+			case modification_type::remove_values:    return LDAP_MOD_DELETE | LDAP_MOD_BVALUES;
+			case modification_type::remove_attribute: return LDAP_MOD_DELETE;
+			case modification_type::replace:          return LDAP_MOD_REPLACE | LDAP_MOD_BVALUES;
+		}
+		throw std::logic_error("unknown modification type: " + std::to_string(int(type)));
+	}
+}
+
+void modification_buffer::clear() {
+	attributes_.clear();
+	values_.clear();
+	entries_.clear();
+}
+
+void modification_buffer::add_entry_(modification_type type, std::string_view attribute) {
+	entries_.push_back(entry{to_ldap_mod_op(type), attributes_.size(), values_.size(), values_.size()});
+	attributes_.insert(attributes_.end(), attribute.begin(), attribute.end());
+	attributes_.push_back('\0');
+}
+
+LDAPMod * * modification_buffer::native() {
+	// Everything is stored by index while building, since the vectors may have been re-allocated.
+	// Now that the buffer is complete, the pointers can be resolved without invalidation.
+	value_ptrs_.clear();
+	value_ptrs_.reserve(values_.size() + entries_.size());
+	mods_.resize(entries_.size());
+	mod_ptrs_.clear();
+	mod_ptrs_.reserve(entries_.size() + 1);
+
+	for (std::size_t i = 0; i < entries_.size(); ++i) {
+		entry const & entry = entries_[i];
+		LDAPMod & mod = mods_[i];
+		mod.mod_op   = entry.operation;
+		mod.mod_type = attributes_.data() + entry.attribute;
+
+		if (entry.operation & LDAP_MOD_BVALUES) {
+			mod.mod_vals.modv_bvals = value_ptrs_.data() + value_ptrs_.size();
+			for (std::size_t j = entry.values_begin; j < entry.values_end; ++j) value_ptrs_.push_back(&values_[j]);
+			value_ptrs_.push_back(nullptr);
+		} else {
+			mod.mod_vals.modv_strvals = nullptr;
+		}
+
+		mod_ptrs_.push_back(&mod);
+	}
+
+	mod_ptrs_.push_back(nullptr);
+	return mod_ptrs_.data();
+}
+
+}
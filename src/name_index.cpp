@@ -0,0 +1,87 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "detail/name_index.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace ldapxx {
+
+std::size_t name_index::find_slot_(std::string_view name, std::uint32_t hash) const {
+	std::size_t mask = slots_.size() - 1;
+	for (std::size_t index = hash & mask;; index = (index + 1) & mask) {
+		slot const & slot = slots_[index];
+		if (slot.id == no_id) return index;
+		if (slot.hash == hash && iequals(name, std::string_view{names_}.substr(slot.offset, slot.length))) return index;
+	}
+}
+
+void name_index::rehash_(std::size_t capacity) {
+	std::vector<slot> old = std::exchange(slots_, std::vector<slot>(capacity));
+	std::size_t mask = capacity - 1;
+	for (slot const & entry : old) {
+		if (entry.id == no_id) continue;
+		std::size_t index = entry.hash & mask;
+		while (slots_[index].id != no_id) index = (index + 1) & mask;
+		slots_[index] = entry;
+	}
+}
+
+void name_index::reserve(std::size_t count, std::size_t bytes) {
+	// Keep the load factor at or below one half, so probe sequences stay short.
+	std::size_t capacity = std::max<std::size_t>(16, slots_.size());
+	while (capacity < count * 2) capacity *= 2;
+	if (capacity > slots_.size()) rehash_(capacity);
+	names_.reserve(bytes);
+}
+
+std::uint32_t name_index::insert(std::string_view name, std::uint32_t id) {
+	reserve(size_ + 1);
+
+	std::uint32_t hash = hash_name(name);
+	slot & slot = slots_[find_slot_(name, hash)];
+	if (slot.id != no_id) return slot.id;
+
+	slot = {hash, id, std::uint32_t(names_.size()), std::uint32_t(name.size())};
+	names_.append(name);
+	++size_;
+	return id;
+}
+
+std::uint32_t name_index::find(std::string_view name) const {
+	if (slots_.empty()) return no_id;
+	return slots_[find_slot_(name, hash_name(name))].id;
+}
+
+void name_index::clear() {
+	slots_.clear();
+	names_.clear();
+	size_ = 0;
+}
+
+}
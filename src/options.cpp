@@ -212,4 +212,19 @@ void set_tls_require_cert(LDAP * connection, require_cert_t verify) {
 	set_option(connection, LDAP_OPT_X_TLS_REQUIRE_CERT, int(verify));
 }
 
+void set_tls_new_context(LDAP * connection) {
+	set_option(connection, LDAP_OPT_X_TLS_NEWCTX, int(0));
+}
+
+void * get_tls_context(LDAP * connection) {
+	return get_option<void *>(connection, LDAP_OPT_X_TLS_CTX);
+}
+
+void set_tls_context(LDAP * connection, void * context) {
+	// Unlike most options, the context itself is passed rather than a pointer to it.
+	if (int code = ldap_set_option(connection, LDAP_OPT_X_TLS_CTX, context)) {
+		throw error{errc(code), "setting option " + std::to_string(LDAP_OPT_X_TLS_CTX)};
+	}
+}
+
 }
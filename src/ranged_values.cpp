@@ -0,0 +1,142 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ranged_values.hpp"
+#include "walk_result.hpp"
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <utility>
+
+namespace ldapxx {
+
+namespace {
+	/// Parse an unsigned number from the start of a string, removing it from the view.
+	boost::optional<std::size_t> parse_number(std::string_view & input) {
+		std::size_t length = 0;
+		std::size_t result = 0;
+		while (length < input.size() && input[length] >= '0' && input[length] <= '9') {
+			result = result * 10 + (input[length] - '0');
+			++length;
+		}
+		if (length == 0) return boost::none;
+		input.remove_prefix(length);
+		return result;
+	}
+
+	/// A parsed range option.
+	struct value_range {
+		std::size_t low;
+		boost::optional<std::size_t> high; ///< Not set if the range is open ended.
+	};
+
+	/// Parse the range option of an attribute description such as "member;range=0-1499".
+	boost::optional<value_range> parse_range(std::string_view description) {
+		constexpr std::string_view option = ";range=";
+
+		for (std::size_t i = description.find(';'); i != std::string_view::npos; i = description.find(';', i + 1)) {
+			if (!iequals(description.substr(i, option.size()), option)) continue;
+			std::string_view range = description.substr(i + option.size());
+
+			value_range result;
+			boost::optional<std::size_t> low = parse_number(range);
+			if (!low || range.empty() || range.front() != '-') return boost::none;
+			range.remove_prefix(1);
+			result.low = *low;
+			if (!range.empty() && range.front() == '*') return result;
+			result.high = parse_number(range);
+			if (!result.high) return boost::none;
+			return result;
+		}
+		return boost::none;
+	}
+}
+
+ranged_value_reader::ranged_value_reader(
+	ldapxx::connection connection,
+	std::string dn,
+	std::string attribute,
+	std::chrono::milliseconds timeout,
+	std::size_t chunk_size
+) :
+	connection_{connection},
+	dn_{std::move(dn)},
+	attribute_{std::move(attribute)},
+	timeout_{timeout},
+	chunk_size_{chunk_size} {}
+
+berval * * ranged_value_reader::fetch_chunk_() {
+	if (done_) return nullptr;
+
+	std::string description = attribute_;
+	if (ranged_) {
+		description += ";range=" + std::to_string(next_) + "-";
+		if (chunk_size_) description += std::to_string(next_ + chunk_size_ - 1);
+		else description += "*";
+	}
+
+	owned_result result = connection_.search(make_query().base(dn_).scope(scope::base).attributes({description}), timeout_);
+
+	// Find the attribute as returned by the server.
+	// That is either the plain attribute, or the attribute with the actual range of the chunk.
+	boost::optional<entry_t> entry;
+	walk_entries(connection_, result_t{result.get()}, [&] (entry_t found) { if (!entry) entry = found; });
+	if (!entry) throw error{errc::no_such_object, "retrieving ranged attribute values"};
+
+	std::string returned;
+	walk_attributes(connection_, *entry, [&] (char const * name) {
+		std::string_view name_view = name;
+		std::string_view base = name_view.substr(0, name_view.find(';'));
+		if (returned.empty() && iequals(base, attribute_)) returned = name;
+	});
+
+	// Servers without support for ranged retrieval may not return anything for the first range.
+	// Fall back to requesting the plain attribute in that case.
+	if (returned.empty() && ranged_ && next_ == 0) {
+		ranged_ = false;
+		return fetch_chunk_();
+	}
+
+	// No values (left) in the requested range.
+	if (returned.empty()) {
+		done_ = true;
+		return nullptr;
+	}
+
+	boost::optional<value_range> range = parse_range(returned);
+	if (!range || !range->high) {
+		done_ = true;
+	} else {
+		next_ = std::max(*range->high + 1, next_ + 1);
+	}
+
+	berval * * values = ldap_get_values_len(connection_, *entry, returned.c_str());
+	if (!values) throw error{get_result_code(connection_), "retrieving ranged attribute values"};
+	return values;
+}
+
+}
@@ -0,0 +1,371 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "schema.hpp"
+#include "dn.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <ldap_schema.h>
+
+#include <algorithm>
+
+namespace ldapxx {
+
+namespace {
+	/// Fill a name index from a list of (name, ID) pairs, keeping the first ID of duplicate names.
+	void build_index(name_index & index, std::vector<std::pair<std::string_view, std::uint32_t>> const & names) {
+		std::size_t total = 0;
+		for (auto const & name : names) total += name.first.size();
+		index.clear();
+		index.reserve(names.size(), total);
+		for (auto const & [name, id] : names) {
+			if (!name.empty()) index.insert(name, id);
+		}
+	}
+
+	/// Strip attribute options such as ";binary" from an attribute description.
+	std::string_view strip_options(std::string_view attribute) {
+		return attribute.substr(0, attribute.find(';'));
+	}
+
+	/// Check if an attribute description has a specific option.
+	bool has_option(std::string_view attribute, std::string_view option) {
+		for (std::size_t start = attribute.find(';'); start != std::string_view::npos;) {
+			std::size_t end = attribute.find(';', start + 1);
+			if (iequals(attribute.substr(start + 1, end == std::string_view::npos ? end : end - start - 1), option)) return true;
+			start = end;
+		}
+		return false;
+	}
+
+	/// Equality matching rules with a known comparison.
+	struct known_rule {
+		char const * name;
+		char const * oid;
+		value_matching matching;
+	};
+
+	constexpr known_rule known_rules[] = {
+		{"objectIdentifierMatch",   "2.5.13.0",                   value_matching::case_ignore},
+		{"distinguishedNameMatch",  "2.5.13.1",                   value_matching::distinguished_name},
+		{"caseIgnoreMatch",         "2.5.13.2",                   value_matching::case_ignore},
+		{"caseExactMatch",          "2.5.13.5",                   value_matching::case_exact},
+		{"numericStringMatch",      "2.5.13.8",                   value_matching::numeric_string},
+		{"caseIgnoreListMatch",     "2.5.13.11",                  value_matching::case_ignore},
+		{"booleanMatch",            "2.5.13.13",                  value_matching::octet},
+		{"integerMatch",            "2.5.13.14",                  value_matching::octet},
+		{"octetStringMatch",        "2.5.13.17",                  value_matching::octet},
+		{"telephoneNumberMatch",    "2.5.13.20",                  value_matching::telephone_number},
+		{"uniqueMemberMatch",       "2.5.13.23",                  value_matching::distinguished_name},
+		{"generalizedTimeMatch",    "2.5.13.27",                  value_matching::generalized_time},
+		{"caseExactIA5Match",       "1.3.6.1.4.1.1466.109.114.1", value_matching::case_exact},
+		{"caseIgnoreIA5Match",      "1.3.6.1.4.1.1466.109.114.2", value_matching::case_ignore},
+	};
+
+	/// Syntaxes whose values are not text.
+	constexpr char const * binary_syntaxes[] = {
+		"1.3.6.1.4.1.1466.115.121.1.4",  // Audio
+		"1.3.6.1.4.1.1466.115.121.1.5",  // Binary
+		"1.3.6.1.4.1.1466.115.121.1.8",  // Certificate
+		"1.3.6.1.4.1.1466.115.121.1.9",  // Certificate List
+		"1.3.6.1.4.1.1466.115.121.1.10", // Certificate Pair
+		"1.3.6.1.4.1.1466.115.121.1.23", // Fax
+		"1.3.6.1.4.1.1466.115.121.1.28", // JPEG
+		"1.3.6.1.4.1.1466.115.121.1.40", // Octet String
+		"1.3.6.1.4.1.1466.115.121.1.49", // Supported Algorithm
+	};
+
+	known_rule const * find_known_rule(std::string_view name) {
+		for (known_rule const & rule : known_rules) {
+			if (iequals(name, rule.name) || name == rule.oid) return &rule;
+		}
+		return nullptr;
+	}
+
+	bool is_binary_syntax(std::string_view syntax) {
+		// Strip a length bound such as "{128}".
+		syntax = syntax.substr(0, syntax.find('{'));
+		return std::any_of(std::begin(binary_syntaxes), std::end(binary_syntaxes), [&] (char const * oid) { return syntax == oid; });
+	}
+
+	/// Prepare a string for matching, removing insignificant spaces and optionally folding case.
+	/**
+	 * Leading and trailing spaces are removed and runs of spaces are collapsed into one, as in RFC 4518.
+	 */
+	void prepare_string(std::string_view value, bool fold_case, std::string & output) {
+		bool space = false;
+		for (char c : value) {
+			if (c == ' ') {
+				space = true;
+				continue;
+			}
+			if (space && !output.empty()) output.push_back(' ');
+			space = false;
+			output.push_back(fold_case ? ascii_lower(c) : c);
+		}
+	}
+
+	/// Copy a value, removing some characters and folding case.
+	void strip_characters(std::string_view value, std::string_view remove, std::string & output) {
+		for (char c : value) {
+			if (remove.find(c) == std::string_view::npos) output.push_back(ascii_lower(c));
+		}
+	}
+
+	std::vector<std::string> to_strings(char * * input) {
+		std::vector<std::string> result;
+		if (!input) return result;
+		for (char * * i = input; *i; ++i) result.emplace_back(*i);
+		return result;
+	}
+
+	std::string to_string(char const * input) {
+		return input ? std::string{input} : std::string{};
+	}
+
+	/// Collect the values of an attribute as strings, or nothing if the attribute is absent.
+	std::vector<std::string> get_values(LDAP * connection, entry_t entry, char const * attribute) {
+		std::vector<std::string> result;
+		berval * * values = ldap_get_values_len(connection, entry, attribute);
+		if (!values) return result;
+		auto free_values = at_scope_exit([values] () { ldap_value_free_len(values); });
+		int count = ldap_count_values_len(values);
+		for (int i = 0; i < count; ++i) result.emplace_back(values[i]->bv_val, values[i]->bv_len);
+		return result;
+	}
+
+	attribute_type convert(LDAPAttributeType const & input) {
+		attribute_type result;
+		result.oid                  = to_string(input.at_oid);
+		result.names                = to_strings(input.at_names);
+		result.superior             = to_string(input.at_sup_oid);
+		result.syntax               = to_string(input.at_syntax_oid);
+		result.equality             = to_string(input.at_equality_oid);
+		result.ordering             = to_string(input.at_ordering_oid);
+		result.substring            = to_string(input.at_substr_oid);
+		result.single_value         = input.at_single_value;
+		result.no_user_modification = input.at_no_user_mod;
+		result.operational          = input.at_usage != 0;
+		return result;
+	}
+
+	matching_rule convert(LDAPMatchingRule const & input) {
+		matching_rule result;
+		result.oid    = to_string(input.mr_oid);
+		result.names  = to_strings(input.mr_names);
+		result.syntax = to_string(input.mr_syntax_oid);
+		return result;
+	}
+}
+
+schema::schema(std::vector<attribute_type> attributes, std::vector<matching_rule> matching_rules) :
+	attributes_{std::move(attributes)},
+	matching_rules_{std::move(matching_rules)}
+{
+	std::vector<std::pair<std::string_view, std::uint32_t>> names;
+	for (std::size_t i = 0; i < matching_rules_.size(); ++i) {
+		for (std::string const & name : matching_rules_[i].names) names.emplace_back(name, i);
+		names.emplace_back(matching_rules_[i].oid, i);
+	}
+	build_index(matching_rule_index_, names);
+
+	names.clear();
+	for (std::size_t i = 0; i < attributes_.size(); ++i) {
+		for (std::string const & name : attributes_[i].names) names.emplace_back(name, i);
+		names.emplace_back(attributes_[i].oid, i);
+	}
+	build_index(attribute_index_, names);
+
+	// Resolve inherited properties. The depth is bounded, so a cyclic schema can not hang us.
+	for (attribute_type & attribute : attributes_) {
+		std::string_view superior = attribute.superior;
+		for (int depth = 0; depth < 16 && !superior.empty(); ++depth) {
+			std::uint32_t id = attribute_index_.find(superior);
+			if (id == name_index::no_id) break;
+			attribute_type const & parent = attributes_[id];
+			if (attribute.syntax.empty())    attribute.syntax    = parent.syntax;
+			if (attribute.equality.empty())  attribute.equality  = parent.equality;
+			if (attribute.ordering.empty())  attribute.ordering  = parent.ordering;
+			if (attribute.substring.empty()) attribute.substring = parent.substring;
+			superior = parent.superior;
+		}
+
+		known_rule const * rule = find_known_rule(attribute.equality);
+		if (!rule) {
+			// The equality rule may be named differently by this server, so try its OID too.
+			if (matching_rule const * server_rule = find_matching_rule(attribute.equality)) rule = find_known_rule(server_rule->oid);
+		}
+		attribute.matching = rule ? rule->matching : value_matching::octet;
+		attribute.binary   = is_binary_syntax(attribute.syntax);
+	}
+}
+
+boost::optional<std::uint32_t> schema::attribute_id(std::string_view name) const {
+	std::uint32_t id = attribute_index_.find(strip_options(name));
+	if (id == name_index::no_id) return boost::none;
+	return id;
+}
+
+attribute_type const * schema::find(std::string_view name) const {
+	std::uint32_t id = attribute_index_.find(strip_options(name));
+	return id == name_index::no_id ? nullptr : &attributes_[id];
+}
+
+matching_rule const * schema::find_matching_rule(std::string_view name) const {
+	std::uint32_t id = matching_rule_index_.find(name);
+	return id == name_index::no_id ? nullptr : &matching_rules_[id];
+}
+
+bool schema::is_binary(std::string_view attribute) const {
+	if (has_option(attribute, "binary")) return true;
+	attribute_type const * type = find(attribute);
+	return type && type->binary;
+}
+
+std::string_view schema::equality_key(std::string_view attribute, std::string_view value, std::string & buffer) const {
+	attribute_type const * type = find(attribute);
+	value_matching matching = type ? type->matching : value_matching::octet;
+
+	buffer.clear();
+	switch (matching) {
+		case value_matching::octet:
+			return value;
+		case value_matching::case_exact:
+			prepare_string(value, false, buffer);
+			return buffer;
+		case value_matching::case_ignore:
+			prepare_string(value, true, buffer);
+			return buffer;
+		case value_matching::numeric_string:
+			// Digits are not affected by case folding.
+			strip_characters(value, " ", buffer);
+			return buffer;
+		case value_matching::telephone_number:
+			strip_characters(value, " -", buffer);
+			return buffer;
+		case value_matching::distinguished_name:
+			if (!normalize_dn(value, buffer)) return value;
+			return buffer;
+		case value_matching::generalized_time: {
+			auto time = parse_generalized_time(value);
+			if (!time) return value;
+			buffer = format_generalized_time(*time);
+			return buffer;
+		}
+	}
+	return value;
+}
+
+bool schema::values_equal(std::string_view attribute, std::string_view a, std::string_view b) const {
+	std::string buffer_a;
+	std::string buffer_b;
+	return equality_key(attribute, a, buffer_a) == equality_key(attribute, b, buffer_b);
+}
+
+std::shared_ptr<schema const> load_schema(connection & connection, operation_limits const & limits) {
+	std::error_code error;
+	std::shared_ptr<schema const> result = load_schema(connection, limits, error);
+	throw_if(error, "loading schema");
+	return result;
+}
+
+std::shared_ptr<schema const> load_schema(connection & connection, operation_limits const & limits, std::error_code & error) {
+	error = {};
+
+	// Find the subschema subentry in the root DSE.
+	ldapxx::query root;
+	root.attributes = {"subschemaSubentry"};
+	owned_result result = connection.search(root, limits, 1, error);
+	if (error) return nullptr;
+
+	std::string subentry;
+	walk_entries(connection, result_t{result.get()}, [&] (entry_t entry) {
+		std::vector<std::string> values = get_values(connection, entry, "subschemaSubentry");
+		if (!values.empty()) subentry = std::move(values.front());
+	});
+	if (subentry.empty()) subentry = "cn=Subschema";
+
+	// The schema attributes are operational, so they must be requested explicitly.
+	ldapxx::query query;
+	query.base       = subentry;
+	query.filter     = "(objectClass=subschema)";
+	query.attributes = {"attributeTypes", "matchingRules"};
+	result = connection.search(query, limits, 1, error);
+	if (error) return nullptr;
+
+	std::vector<attribute_type> attributes;
+	std::vector<matching_rule> matching_rules;
+	walk_entries(connection, result_t{result.get()}, [&] (entry_t entry) {
+		for (std::string const & value : get_values(connection, entry, "attributeTypes")) {
+			int code = 0;
+			char const * error_position = nullptr;
+			LDAPAttributeType * parsed = ldap_str2attributetype(value.c_str(), &code, &error_position, LDAP_SCHEMA_ALLOW_ALL);
+			if (!parsed) continue;
+			attributes.push_back(convert(*parsed));
+			ldap_attributetype_free(parsed);
+		}
+
+		for (std::string const & value : get_values(connection, entry, "matchingRules")) {
+			int code = 0;
+			char const * error_position = nullptr;
+			LDAPMatchingRule * parsed = ldap_str2matchingrule(value.c_str(), &code, &error_position, LDAP_SCHEMA_ALLOW_ALL);
+			if (!parsed) continue;
+			matching_rules.push_back(convert(*parsed));
+			ldap_matchingrule_free(parsed);
+		}
+	});
+
+	return std::make_shared<schema const>(std::move(attributes), std::move(matching_rules));
+}
+
+std::shared_ptr<schema const> schema_cache::get(connection & connection, operation_limits const & limits) {
+	std::error_code error;
+	std::shared_ptr<schema const> result = get(connection, limits, error);
+	throw_if(error, "loading schema");
+	return result;
+}
+
+std::shared_ptr<schema const> schema_cache::get(connection & connection, operation_limits const & limits, std::error_code & error) {
+	error = {};
+
+	// Hold the lock while loading, so concurrent callers wait for a single load instead of all fetching the schema.
+	std::lock_guard<std::mutex> lock{mutex_};
+	if (!schema_) schema_ = load_schema(connection, limits, error);
+	return schema_;
+}
+
+std::shared_ptr<schema const> schema_cache::cached() {
+	std::lock_guard<std::mutex> lock{mutex_};
+	return schema_;
+}
+
+void schema_cache::invalidate() {
+	std::lock_guard<std::mutex> lock{mutex_};
+	schema_ = nullptr;
+}
+
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "detail/sha256.hpp"
+#include "error.hpp"
+
+#ifdef LDAPXX_HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
+
+namespace ldapxx {
+
+namespace {
+	constexpr std::array<std::uint32_t, 64> round_constants = {{
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+	}};
+
+	constexpr std::uint32_t rotate_right(std::uint32_t value, int count) {
+		return (value >> count) | (value << (32 - count));
+	}
+}
+
+sha256::sha256() :
+	state_{{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}}
+{
+#ifdef LDAPXX_HAVE_OPENSSL
+	EVP_MD_CTX * context = EVP_MD_CTX_new();
+	if (!context) throw error{errc::no_memory, "creating SHA-256 context"};
+	native_ = context;
+	if (!EVP_DigestInit_ex(context, EVP_sha256(), nullptr)) {
+		EVP_MD_CTX_free(context);
+		throw error{errc::local_error, "initializing SHA-256 context"};
+	}
+#endif
+}
+
+sha256::~sha256() {
+#ifdef LDAPXX_HAVE_OPENSSL
+	EVP_MD_CTX_free(static_cast<EVP_MD_CTX *>(native_));
+#endif
+}
+
+void sha256::process_block_() {
+	std::array<std::uint32_t, 64> w;
+	for (int i = 0; i < 16; ++i) {
+		w[i] = std::uint32_t(block_[i * 4]) << 24 | std::uint32_t(block_[i * 4 + 1]) << 16 | std::uint32_t(block_[i * 4 + 2]) << 8 | block_[i * 4 + 3];
+	}
+	for (int i = 16; i < 64; ++i) {
+		std::uint32_t s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		std::uint32_t s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	std::array<std::uint32_t, 8> s = state_;
+	for (int i = 0; i < 64; ++i) {
+		std::uint32_t s1     = rotate_right(s[4], 6) ^ rotate_right(s[4], 11) ^ rotate_right(s[4], 25);
+		std::uint32_t choice = (s[4] & s[5]) ^ (~s[4] & s[6]);
+		std::uint32_t temp1  = s[7] + s1 + choice + round_constants[i] + w[i];
+		std::uint32_t s0     = rotate_right(s[0], 2) ^ rotate_right(s[0], 13) ^ rotate_right(s[0], 22);
+		std::uint32_t major  = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+		std::uint32_t temp2  = s0 + major;
+		s = {{temp1 + temp2, s[0], s[1], s[2], s[3] + temp1, s[4], s[5], s[6]}};
+	}
+	for (int i = 0; i < 8; ++i) state_[i] += s[i];
+	block_size_ = 0;
+}
+
+void sha256::update(std::string_view data) {
+#ifdef LDAPXX_HAVE_OPENSSL
+	if (!EVP_DigestUpdate(static_cast<EVP_MD_CTX *>(native_), data.data(), data.size())) throw error{errc::local_error, "updating SHA-256 hash"};
+#else
+	length_ += data.size();
+	for (char c : data) {
+		block_[block_size_++] = std::uint8_t(c);
+		if (block_size_ == block_.size()) process_block_();
+	}
+#endif
+}
+
+sha256::digest sha256::finish() {
+#ifdef LDAPXX_HAVE_OPENSSL
+	digest result;
+	if (!EVP_DigestFinal_ex(static_cast<EVP_MD_CTX *>(native_), result.data(), nullptr)) throw error{errc::local_error, "finishing SHA-256 hash"};
+	return result;
+#else
+	std::uint64_t bits = length_ * 8;
+
+	block_[block_size_++] = 0x80;
+	if (block_size_ > 56) {
+		while (block_size_ < 64) block_[block_size_++] = 0;
+		process_block_();
+	}
+	while (block_size_ < 56) block_[block_size_++] = 0;
+	for (int i = 7; i >= 0; --i) block_[block_size_++] = std::uint8_t(bits >> (i * 8));
+	process_block_();
+
+	digest result;
+	for (int i = 0; i < 8; ++i) {
+		result[i * 4]     = std::uint8_t(state_[i] >> 24);
+		result[i * 4 + 1] = std::uint8_t(state_[i] >> 16);
+		result[i * 4 + 2] = std::uint8_t(state_[i] >> 8);
+		result[i * 4 + 3] = std::uint8_t(state_[i]);
+	}
+	return result;
+#endif
+}
+
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "shared_connection.hpp"
+#include "walk_result.hpp"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+
+namespace ldapxx {
+
+namespace {
+	/// Wait for a result and check its result code.
+	void check_result(shared_connection & connection, std::function<int (ldapxx::connection, std::error_code &)> const & send, operation_limits const & limits, std::error_code & error) {
+		owned_result result = connection.execute(send, limits, error);
+		if (error) return;
+		errc code = connection.result_code(result, error);
+		if (error) return;
+		if (code != errc::success) error = code;
+	}
+}
+
+shared_connection::shared_connection(owned_connection connection) : connection_{std::move(connection)} {
+	int fd = -1;
+	if (ldap_get_option(connection_, LDAP_OPT_DESC, &fd) != LDAP_OPT_SUCCESS || fd < 0) {
+		throw error{errc::param_error, "sharing connection: connection is not open"};
+	}
+	if (pipe(wake_up_) != 0) throw error{errc::local_error, "sharing connection: creating wake up pipe"};
+	reader_ = std::thread{[this] () { read_loop_(); }};
+}
+
+shared_connection::~shared_connection() {
+	stopping_ = true;
+	char byte = 0;
+	while (write(wake_up_[1], &byte, 1) < 0 && errno == EINTR) {}
+	reader_.join();
+
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		fail_pending_(errc::server_down);
+	}
+	close(wake_up_[0]);
+	close(wake_up_[1]);
+}
+
+errc shared_connection::result_code(result_t result, std::error_code & error) {
+	std::lock_guard<std::mutex> lock{mutex_};
+	return ldapxx::result_code(connection_, result, error);
+}
+
+bool shared_connection::broken() {
+	std::lock_guard<std::mutex> lock{mutex_};
+	return bool(broken_);
+}
+
+void shared_connection::fail_pending_(std::error_code const & error) {
+	if (!broken_) broken_ = error;
+	for (auto & request : pending_) request.second.set_value(nullptr);
+	pending_.clear();
+}
+
+void shared_connection::read_loop_() {
+	int fd = -1;
+	ldap_get_option(connection_, LDAP_OPT_DESC, &fd);
+
+	while (!stopping_) {
+		// Wait for data without holding the lock, so other threads can send requests meanwhile.
+		std::array<pollfd, 2> fds{{{fd, POLLIN, 0}, {wake_up_[0], POLLIN, 0}}};
+		if (poll(fds.data(), fds.size(), -1) < 0) {
+			if (errno == EINTR) continue;
+			std::lock_guard<std::mutex> lock{mutex_};
+			fail_pending_(errc::local_error);
+			return;
+		}
+		if (fds[1].revents) return;
+
+		// Drain all complete responses, including any the library already buffered.
+		std::lock_guard<std::mutex> lock{mutex_};
+		while (true) {
+			timeval zero{0, 0};
+			LDAPMessage * message = nullptr;
+			int type = ldap_result(connection_, LDAP_RES_ANY, LDAP_MSG_ALL, &zero, &message);
+			owned_result result{message};
+			if (type == 0) break;
+			if (type == -1) {
+				int code = LDAP_SERVER_DOWN;
+				ldap_get_option(connection_, LDAP_OPT_RESULT_CODE, &code);
+				fail_pending_(errc(code));
+				return;
+			}
+
+			// Responses to abandoned requests are simply dropped.
+			auto request = pending_.find(ldap_msgid(message));
+			if (request == pending_.end()) continue;
+			request->second.set_value(std::move(result));
+			pending_.erase(request);
+		}
+	}
+}
+
+owned_result shared_connection::execute(
+	std::function<int (ldapxx::connection connection, std::error_code & error)> const & send,
+	operation_limits const & limits,
+	std::error_code & error
+) {
+	error = {};
+	if (limits.remaining().count() == 0) {
+		error = errc::timeout;
+		return nullptr;
+	}
+
+	int message_id;
+	std::future<owned_result> future;
+	{
+		// Register the request before the lock is released, so the reader can't see the response first.
+		std::lock_guard<std::mutex> lock{mutex_};
+		if (broken_) {
+			error = broken_;
+			return nullptr;
+		}
+		message_id = send(ldapxx::connection{connection_.get()}, error);
+		if (error) return nullptr;
+		future = pending_[message_id].get_future();
+	}
+
+	while (true) {
+		auto wake_up = limits.deadline;
+		if (limits.cancel) wake_up = std::min(wake_up, operation_limits::clock::now() + limits.poll_interval);
+
+		if (future.wait_until(wake_up) == std::future_status::ready) {
+			owned_result result = future.get();
+			if (!result) {
+				std::lock_guard<std::mutex> lock{mutex_};
+				error = broken_;
+			}
+			return result;
+		}
+
+		bool cancelled = limits.cancelled();
+		if (!cancelled && operation_limits::clock::now() < limits.deadline) continue;
+
+		std::lock_guard<std::mutex> lock{mutex_};
+		// The response may have arrived just now, in which case it is ready in the future.
+		if (pending_.erase(message_id)) {
+			ldap_abandon_ext(connection_, message_id, nullptr, nullptr);
+			error = cancelled ? errc::user_cancelled : errc::timeout;
+			return nullptr;
+		}
+	}
+}
+
+owned_result shared_connection::search(query const & query, operation_limits const & limits, std::size_t max_response_size) {
+	std::error_code error;
+	owned_result result = search(query, limits, max_response_size, error);
+	throw_if(error, "performing LDAP search");
+	return result;
+}
+
+owned_result shared_connection::search(query const & query, operation_limits const & limits, std::size_t max_response_size, std::error_code & error) {
+	owned_result result = execute([&] (ldapxx::connection connection, std::error_code & error) {
+		return connection.search_async(query, limits.time_limit(), max_response_size, nullptr, error);
+	}, limits, error);
+	if (error) return result;
+
+	errc code = result_code(result, error);
+	if (!error && code != errc::success) error = code;
+	return result;
+}
+
+void shared_connection::modify(std::string const & dn, modification_buffer & modifications, operation_limits const & limits) {
+	std::error_code error;
+	modify(dn, modifications, limits, error);
+	throw_if(error, "applying modifications");
+}
+
+void shared_connection::modify(std::string const & dn, modification_buffer & modifications, operation_limits const & limits, std::error_code & error) {
+	check_result(*this, [&] (ldapxx::connection connection, std::error_code & error) {
+		return connection.modify_async(dn, modifications, nullptr, error);
+	}, limits, error);
+}
+
+void shared_connection::add_entry(std::string const & dn, modification_buffer & attributes, operation_limits const & limits) {
+	std::error_code error;
+	add_entry(dn, attributes, limits, error);
+	throw_if(error, "adding entry");
+}
+
+void shared_connection::add_entry(std::string const & dn, modification_buffer & attributes, operation_limits const & limits, std::error_code & error) {
+	check_result(*this, [&] (ldapxx::connection connection, std::error_code & error) {
+		return connection.add_entry_async(dn, attributes, nullptr, error);
+	}, limits, error);
+}
+
+void shared_connection::remove_entry(std::string const & dn, operation_limits const & limits) {
+	std::error_code error;
+	remove_entry(dn, limits, error);
+	throw_if(error, "deleting entry");
+}
+
+void shared_connection::remove_entry(std::string const & dn, operation_limits const & limits, std::error_code & error) {
+	check_result(*this, [&] (ldapxx::connection connection, std::error_code & error) {
+		return connection.remove_entry_async(dn, nullptr, error);
+	}, limits, error);
+}
+
+bool shared_connection::compare(std::string const & dn, std::string const & attribute, std::string_view value, operation_limits const & limits) {
+	std::error_code error;
+	bool result = compare(dn, attribute, value, limits, error);
+	throw_if(error, "comparing attribute value");
+	return result;
+}
+
+bool shared_connection::compare(std::string const & dn, std::string const & attribute, std::string_view value, operation_limits const & limits, std::error_code & error) {
+	owned_result result = execute([&] (ldapxx::connection connection, std::error_code & error) {
+		return connection.compare_async(dn, attribute, value, error);
+	}, limits, error);
+	if (error) return false;
+
+	errc code = result_code(result, error);
+	if (error) return false;
+	if (code == errc::compare_true)  return true;
+	if (code == errc::compare_false) return false;
+	error = code;
+	return false;
+}
+
+}
@@ -0,0 +1,265 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "subtree_delete.hpp"
+#include "dn.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace ldapxx {
+
+namespace {
+	constexpr char const * tree_delete_oid = "1.2.840.113556.1.4.805";
+
+	constexpr std::size_t no_parent = std::numeric_limits<std::size_t>::max();
+
+	/// Check if the root DSE lists a control as supported.
+	bool supports_control(connection & connection, char const * oid, operation_limits const & limits, std::error_code & error) {
+		ldapxx::query query;
+		query.attributes = {"supportedControl"};
+		owned_result result = connection.search(query, limits, 1, error);
+		if (error) return false;
+
+		bool found = false;
+		walk_entries(connection, result_t{result.get()}, [&] (entry_t entry) {
+			berval * * values = ldap_get_values_len(connection, entry, "supportedControl");
+			if (!values) return;
+			auto free_values = at_scope_exit([values] () { ldap_value_free_len(values); });
+			int count = ldap_count_values_len(values);
+			for (int i = 0; i < count; ++i) {
+				if (values[i]->bv_len == std::strlen(oid) && std::memcmp(values[i]->bv_val, oid, values[i]->bv_len) == 0) found = true;
+			}
+		});
+		return found;
+	}
+
+	/// Wait for any response on the connection within limits.
+	owned_result wait_any(LDAP * connection, operation_limits const & limits, std::error_code & error) {
+		owned_result result;
+		limits.wait_in_slices([&] (std::chrono::milliseconds slice) {
+			timeval timeout = to_timeval(slice);
+			LDAPMessage * message = nullptr;
+			int type = ldap_result(connection, LDAP_RES_ANY, LDAP_MSG_ALL, &timeout, &message);
+			result.reset(message);
+			if (type == -1) error = last_result_code(connection);
+			return type != 0;
+		}, error);
+		if (error) return nullptr;
+		return result;
+	}
+
+	/// An entry of the subtree to delete.
+	struct node {
+		std::string dn;
+		std::size_t parent   = no_parent;
+		std::size_t children = 0;
+	};
+
+	/// Check the result of a page and get the cookie for the next page.
+	/**
+	 * The cookie is left empty after the last page,
+	 * or if the server ignored the paged results control.
+	 */
+	void parse_page_result(LDAP * connection, LDAPMessage * result, std::string & cookie, std::error_code & error) {
+		cookie.clear();
+		LDAPMessage * message = find_search_result(connection, result);
+		if (!message) {
+			error = errc::protocol_error;
+			return;
+		}
+
+		int code = LDAP_OTHER;
+		LDAPControl * * response_controls = nullptr;
+		error = errc(ldap_parse_result(connection, message, &code, nullptr, nullptr, nullptr, &response_controls, 0));
+		auto free_response_controls = at_scope_exit([&] () { if (response_controls) ldap_controls_free(response_controls); });
+		if (error) return;
+		if (code != LDAP_SUCCESS) {
+			error = errc(code);
+			return;
+		}
+
+		LDAPControl * response = ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, response_controls, nullptr);
+		if (!response) return;
+
+		ber_int_t count = 0;
+		berval next{0, nullptr};
+		error = errc(ldap_parse_pageresponse_control(connection, response, &count, &next));
+		if (next.bv_val) {
+			cookie.assign(next.bv_val, next.bv_len);
+			ldap_memfree(next.bv_val);
+		}
+	}
+
+	/// Enumerate the subtree and link every entry to its parent.
+	/**
+	 * The subtree is read in pages, so large subtrees don't run into the size limit of the server.
+	 */
+	std::vector<node> enumerate_subtree(connection & connection, std::string const & dn, std::size_t page_size, operation_limits const & limits, std::error_code & error) {
+		ldapxx::query query;
+		query.base       = dn;
+		query.scope      = scope::subtree;
+		query.attributes = {LDAP_NO_ATTRS};
+
+		std::vector<node> nodes;
+		std::vector<std::string> keys;
+		std::string cookie;
+		do {
+			if (limits.remaining().count() == 0) {
+				error = errc::timeout;
+				return {};
+			}
+
+			berval cookie_ber = to_berval(cookie);
+			LDAPControl * control = nullptr;
+			ber_int_t size = ber_int_t(std::min<std::size_t>(page_size, std::numeric_limits<ber_int_t>::max()));
+			error = errc(ldap_create_page_control(connection, size, &cookie_ber, 0, &control));
+			if (error) return {};
+			auto free_control = at_scope_exit([control] () { ldap_control_free(control); });
+			LDAPControl * controls[] = {control, nullptr};
+
+			// The pages bound the size of each response, so don't impose a size limit.
+			int message_id = connection.search_async(query, limits.time_limit(), 0, controls, error);
+			if (error) return {};
+			owned_result result = connection.wait_result(message_id, limits, error);
+			if (error) return {};
+
+			walk_entries(connection, result_t{result.get()}, [&] (entry_t entry) {
+				char * entry_dn = ldap_get_dn(connection, entry);
+				if (!entry_dn) return;
+				nodes.push_back(node{entry_dn});
+				ldap_memfree(entry_dn);
+
+				std::string key;
+				if (!normalize_dn(nodes.back().dn, key)) key = nodes.back().dn;
+				keys.push_back(std::move(key));
+			});
+
+			parse_page_result(connection, result.get(), cookie, error);
+			if (error) return {};
+		} while (!cookie.empty());
+
+		std::unordered_map<std::string_view, std::size_t> index;
+
+		for (std::size_t i = 0; i < keys.size(); ++i) index.emplace(keys[i], i);
+		for (std::size_t i = 0; i < keys.size(); ++i) {
+			auto parent = index.find(dn_parent(keys[i]));
+			if (parent == index.end() || parent->second == i) continue;
+			nodes[i].parent = parent->second;
+			++nodes[parent->second].children;
+		}
+		return nodes;
+	}
+
+	/// Delete the subtree entry by entry, leaves first, with a window of requests in flight.
+	void delete_leaves_first(connection & connection, std::vector<node> & nodes, operation_limits const & limits, std::size_t window, std::error_code & error) {
+		std::vector<std::size_t> ready;
+		for (std::size_t i = 0; i < nodes.size(); ++i) {
+			if (nodes[i].children == 0) ready.push_back(i);
+		}
+
+		std::unordered_map<int, std::size_t> in_flight;
+		auto abandon_in_flight = [&] () {
+			for (auto const & request : in_flight) ldap_abandon_ext(connection, request.first, nullptr, nullptr);
+		};
+
+		while (!ready.empty() || !in_flight.empty()) {
+			while (!ready.empty() && in_flight.size() < window) {
+				std::size_t i = ready.back();
+				ready.pop_back();
+				int message_id = connection.remove_entry_async(nodes[i].dn, nullptr, error);
+				if (error) {
+					abandon_in_flight();
+					return;
+				}
+				in_flight.emplace(message_id, i);
+			}
+
+			owned_result response = wait_any(connection, limits, error);
+			if (error) {
+				abandon_in_flight();
+				return;
+			}
+
+			auto request = in_flight.find(ldap_msgid(response.get()));
+			if (request == in_flight.end()) continue;
+			std::size_t i = request->second;
+			in_flight.erase(request);
+
+			errc code = result_code(connection, result_t{response.get()}, error);
+			if (!error && code != errc::success && code != errc::no_such_object) error = code;
+			if (error) {
+				abandon_in_flight();
+				return;
+			}
+
+			std::size_t parent = nodes[i].parent;
+			if (parent != no_parent && --nodes[parent].children == 0) ready.push_back(parent);
+		}
+	}
+}
+
+void remove_subtree(connection & connection, std::string const & dn, operation_limits const & limits, subtree_delete_options const & options) {
+	std::error_code error;
+	remove_subtree(connection, dn, limits, options, error);
+	throw_if(error, "deleting subtree");
+}
+
+void remove_subtree(connection & connection, std::string const & dn, operation_limits const & limits, subtree_delete_options const & options, std::error_code & error) {
+	error = {};
+
+	if (options.use_tree_delete) {
+		bool supported = supports_control(connection, tree_delete_oid, limits, error);
+		if (error) return;
+
+		if (supported) {
+			LDAPControl control;
+			control.ldctl_oid        = const_cast<char *>(tree_delete_oid);
+			control.ldctl_value      = berval{0, nullptr};
+			control.ldctl_iscritical = 1;
+			LDAPControl * controls[] = {&control, nullptr};
+
+			int message_id = connection.remove_entry_async(dn, controls, error);
+			if (error) return;
+			owned_result result = connection.wait_result(message_id, limits, error);
+			if (error) return;
+			errc code = ldapxx::result_code(connection, result, error);
+			if (!error && code != errc::success) error = code;
+			return;
+		}
+	}
+
+	std::vector<node> nodes = enumerate_subtree(connection, dn, std::max<std::size_t>(options.page_size, 1), limits, error);
+	if (error) return;
+	delete_leaves_first(connection, nodes, limits, std::max<std::size_t>(options.window, 1), error);
+}
+
+}
@@ -0,0 +1,440 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sync.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <lber.h>
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace ldapxx {
+
+namespace {
+	/// Result code sent by the server when it can not resume from the cookie (e-syncRefreshRequired).
+	constexpr int sync_refresh_required = 0x1000;
+
+	/// Free a BER element and its buffer by calling ber_free().
+	struct ber_deleter {
+		void operator() (BerElement * ber) { ber_free(ber, 1); }
+	};
+
+	using owned_ber = std::unique_ptr<BerElement, ber_deleter>;
+
+	/// Start decoding a BER encoded value.
+	owned_ber decode(berval const & value, std::error_code & error) {
+		owned_ber ber{ber_init(const_cast<berval *>(&value))};
+		if (!ber) error = errc::no_memory;
+		return ber;
+	}
+
+	/// Read an optional syncCookie.
+	/**
+	 * The returned value points into the buffer of the BER element.
+	 */
+	bool read_cookie(BerElement * ber, boost::optional<berval> & cookie) {
+		ber_len_t length = 0;
+		if (ber_peek_tag(ber, &length) != LDAP_TAG_SYNC_COOKIE) return true;
+		berval value{0, nullptr};
+		if (ber_scanf(ber, "m", &value) == LBER_ERROR) return false;
+		cookie = value;
+		return true;
+	}
+
+	/// Read an optional boolean, leaving the value untouched if it is absent.
+	bool read_boolean(BerElement * ber, ber_int_t & value) {
+		ber_len_t length = 0;
+		if (ber_peek_tag(ber, &length) != LBER_BOOLEAN) return true;
+		return ber_scanf(ber, "b", &value) != LBER_ERROR;
+	}
+}
+
+sync_consumer::sync_consumer(ldapxx::connection connection, ldapxx::query query, sync_mode mode, sync_callbacks callbacks, std::string cookie) :
+	connection_{connection},
+	query_{std::move(query)},
+	mode_{mode},
+	callbacks_{std::move(callbacks)},
+	cookie_{std::move(cookie)} {}
+
+sync_consumer::~sync_consumer() {
+	stop();
+}
+
+void sync_consumer::start() {
+	std::error_code error;
+	start(error);
+	throw_if(error, "starting content synchronization");
+}
+
+void sync_consumer::start(std::error_code & error) {
+	error = {};
+	if (message_id_ >= 0) return;
+
+	BerElement * ber = ber_alloc_t(LBER_USE_DER);
+	if (!ber) {
+		error = errc::no_memory;
+		return;
+	}
+	auto free_ber = at_scope_exit([ber] () { ber_free(ber, 1); });
+
+	berval cookie = to_berval(cookie_);
+	int encoded = cookie_.empty()
+		? ber_printf(ber, "{e}", ber_int_t(mode_))
+		: ber_printf(ber, "{eO}", ber_int_t(mode_), &cookie);
+
+	LDAPControl control;
+	if (encoded == -1 || ber_flatten2(ber, &control.ldctl_value, 0) == -1) {
+		error = errc::encoding_error;
+		return;
+	}
+	control.ldctl_oid        = const_cast<char *>(LDAP_CONTROL_SYNC);
+	control.ldctl_iscritical = 1;
+	LDAPControl * controls[] = {&control, nullptr};
+
+	// A replica wants every entry, and a refreshAndPersist search never finishes,
+	// so impose neither a size limit nor a time limit (zero means no limit for both).
+	std::chrono::milliseconds no_time_limit{0};
+	int message_id = connection_.search_async(query_, no_time_limit, 0, controls, error);
+	if (error) return;
+	message_id_   = message_id;
+	refresh_done_ = false;
+	if (callbacks_.refresh_started) callbacks_.refresh_started();
+}
+
+bool sync_consumer::poll(std::chrono::milliseconds timeout) {
+	std::error_code error;
+	bool result = poll(timeout, error);
+	throw_if(error, "processing content synchronization");
+	return result;
+}
+
+bool sync_consumer::poll(std::chrono::milliseconds timeout, std::error_code & error) {
+	error = {};
+	timeval timeout_c = to_timeval(timeout);
+
+	while (message_id_ >= 0) {
+		LDAPMessage * message = nullptr;
+		int type = ldap_result(connection_, message_id_, LDAP_MSG_ONE, &timeout_c, &message);
+		owned_result safe_message{message};
+		if (type == 0) break;
+		if (type == -1) {
+			error = last_result_code(connection_);
+			message_id_ = -1;
+			break;
+		}
+
+		if      (type == LDAP_RES_SEARCH_ENTRY)  handle_entry_(message, error);
+		else if (type == LDAP_RES_INTERMEDIATE)  handle_intermediate_(message, error);
+		else if (type == LDAP_RES_SEARCH_RESULT) handle_result_(message, error);
+
+		if (error) {
+			stop();
+			break;
+		}
+
+		// Process everything that already arrived, but don't wait for more.
+		timeout_c = timeval{0, 0};
+	}
+
+	return message_id_ >= 0;
+}
+
+void sync_consumer::run(operation_limits const & limits) {
+	std::error_code error;
+	run(limits, error);
+	throw_if(error, "processing content synchronization");
+}
+
+void sync_consumer::run(operation_limits const & limits, std::error_code & error) {
+	bool done = limits.wait_in_slices([&] (std::chrono::milliseconds slice) {
+		return !poll(slice, error);
+	}, error);
+	if (!done) stop();
+}
+
+void sync_consumer::stop() {
+	if (message_id_ < 0) return;
+	ldap_abandon_ext(connection_, message_id_, nullptr, nullptr);
+	message_id_ = -1;
+}
+
+void sync_consumer::set_cookie_(berval const & cookie) {
+	cookie_.assign(cookie.bv_val, cookie.bv_len);
+	if (callbacks_.cookie) callbacks_.cookie(cookie_);
+}
+
+void sync_consumer::finish_refresh_() {
+	if (refresh_done_) return;
+	refresh_done_ = true;
+	if (callbacks_.refresh_done) callbacks_.refresh_done();
+}
+
+void sync_consumer::handle_entry_(LDAPMessage * message, std::error_code & error) {
+	LDAPControl * * controls = nullptr;
+	int code = ldap_get_entry_controls(connection_, message, &controls);
+	auto free_controls = at_scope_exit([&] () { if (controls) ldap_controls_free(controls); });
+	if (code != LDAP_SUCCESS) {
+		error = errc(code);
+		return;
+	}
+
+	LDAPControl * control = ldap_control_find(LDAP_CONTROL_SYNC_STATE, controls, nullptr);
+	if (!control) {
+		error = errc::protocol_error;
+		return;
+	}
+
+	owned_ber ber = decode(control->ldctl_value, error);
+	if (error) return;
+
+	ber_int_t state = 0;
+	berval uuid{0, nullptr};
+	boost::optional<berval> cookie;
+	if (ber_scanf(ber.get(), "{em", &state, &uuid) == LBER_ERROR || !read_cookie(ber.get(), cookie)) {
+		error = errc::decoding_error;
+		return;
+	}
+	if (state < LDAP_SYNC_PRESENT || state > LDAP_SYNC_DELETE) {
+		error = errc::protocol_error;
+		return;
+	}
+
+	if (callbacks_.entry) callbacks_.entry(sync_state(state), std::string_view{uuid.bv_val, uuid.bv_len}, connection_, entry_t{message});
+
+	// The cookie reflects the state after applying the entry, so only update it afterwards.
+	if (cookie) set_cookie_(*cookie);
+}
+
+void sync_consumer::handle_intermediate_(LDAPMessage * message, std::error_code & error) {
+	char * oid    = nullptr;
+	berval * data = nullptr;
+	int code = ldap_parse_intermediate(connection_, message, &oid, &data, nullptr, 0);
+	auto free_data = at_scope_exit([&] () {
+		if (oid) ldap_memfree(oid);
+		if (data) ber_bvfree(data);
+	});
+	if (code != LDAP_SUCCESS) {
+		error = errc(code);
+		return;
+	}
+
+	// Ignore unrelated intermediate responses.
+	if (!oid || std::strcmp(oid, LDAP_SYNC_INFO) != 0) return;
+	if (!data) {
+		error = errc::protocol_error;
+		return;
+	}
+
+	owned_ber ber = decode(*data, error);
+	if (error) return;
+
+	ber_len_t length = 0;
+	ber_tag_t tag = ber_peek_tag(ber.get(), &length);
+
+	if (tag == LDAP_TAG_SYNC_NEW_COOKIE) {
+		berval cookie{0, nullptr};
+		if (ber_scanf(ber.get(), "m", &cookie) == LBER_ERROR) {
+			error = errc::decoding_error;
+			return;
+		}
+		set_cookie_(cookie);
+	} else if (tag == LDAP_TAG_SYNC_REFRESH_DELETE || tag == LDAP_TAG_SYNC_REFRESH_PRESENT) {
+		boost::optional<berval> cookie;
+		ber_int_t done = 1;
+		if (ber_scanf(ber.get(), "{") == LBER_ERROR || !read_cookie(ber.get(), cookie) || !read_boolean(ber.get(), done)) {
+			error = errc::decoding_error;
+			return;
+		}
+		if (tag == LDAP_TAG_SYNC_REFRESH_PRESENT && callbacks_.present_phase_done) callbacks_.present_phase_done();
+		if (cookie) set_cookie_(*cookie);
+		if (done) finish_refresh_();
+	} else if (tag == LDAP_TAG_SYNC_ID_SET) {
+		boost::optional<berval> cookie;
+		ber_int_t deleted = 0;
+		BerVarray uuids   = nullptr;
+		auto free_uuids   = at_scope_exit([&] () { if (uuids) ber_bvarray_free(uuids); });
+		if (ber_scanf(ber.get(), "{") == LBER_ERROR || !read_cookie(ber.get(), cookie) || !read_boolean(ber.get(), deleted) || ber_scanf(ber.get(), "[W]", &uuids) == LBER_ERROR) {
+			error = errc::decoding_error;
+			return;
+		}
+
+		if (callbacks_.uuids) {
+			std::vector<std::string_view> views;
+			for (BerValue * uuid = uuids; uuid && uuid->bv_val; ++uuid) views.emplace_back(uuid->bv_val, uuid->bv_len);
+			callbacks_.uuids(views, deleted != 0);
+		}
+		if (cookie) set_cookie_(*cookie);
+	} else {
+		error = errc::decoding_error;
+	}
+}
+
+void sync_consumer::handle_result_(LDAPMessage * message, std::error_code & error) {
+	message_id_ = -1;
+
+	int result_code          = LDAP_OTHER;
+	LDAPControl * * controls = nullptr;
+	int code = ldap_parse_result(connection_, message, &result_code, nullptr, nullptr, nullptr, &controls, 0);
+	auto free_controls = at_scope_exit([&] () { if (controls) ldap_controls_free(controls); });
+	if (code != LDAP_SUCCESS) {
+		error = errc(code);
+		return;
+	}
+
+	// The server can no longer resume from the cookie, so start over with a full refresh.
+	// A full refresh has a present phase, so stale entries are still removed by the consumer.
+	if (result_code == sync_refresh_required) {
+		cookie_.clear();
+		if (callbacks_.cookie) callbacks_.cookie(cookie_);
+		start(error);
+		return;
+	}
+
+	if (result_code != LDAP_SUCCESS) {
+		error = errc(result_code);
+		return;
+	}
+
+	if (LDAPControl * control = ldap_control_find(LDAP_CONTROL_SYNC_DONE, controls, nullptr)) {
+		owned_ber ber = decode(control->ldctl_value, error);
+		if (error) return;
+
+		boost::optional<berval> cookie;
+		ber_int_t refresh_deletes = 0;
+		if (ber_scanf(ber.get(), "{") == LBER_ERROR || !read_cookie(ber.get(), cookie) || !read_boolean(ber.get(), refresh_deletes)) {
+			error = errc::decoding_error;
+			return;
+		}
+
+		// Without refreshDeletes, the refresh was a present phase.
+		if (!refresh_done_ && !refresh_deletes && callbacks_.present_phase_done) callbacks_.present_phase_done();
+		if (cookie) set_cookie_(*cookie);
+	}
+
+	finish_refresh_();
+}
+
+sync_callbacks sync_store::callbacks() {
+	sync_callbacks result;
+	result.entry = [this] (sync_state state, std::string_view uuid, LDAP * connection, entry_t entry) {
+		update_(state, uuid, connection, entry);
+	};
+	result.uuids = [this] (std::vector<std::string_view> const & uuids, bool deleted) {
+		update_(uuids, deleted);
+	};
+	// Every refresh may have a present phase, so track the reported entries again from its start.
+	result.refresh_started = [this] () {
+		tracking_ = true;
+		seen_.clear();
+	};
+	result.present_phase_done = [this] () { present_phase_done_(); };
+	result.refresh_done = [this] () {
+		tracking_ = false;
+		seen_.clear();
+	};
+	result.cookie = [this] (std::string_view cookie) {
+		cookie_ = cookie;
+	};
+	return result;
+}
+
+sync_store::entry const * sync_store::find(std::string_view uuid) const {
+	auto found = entries_.find(std::string{uuid});
+	if (found == entries_.end()) return nullptr;
+	return &found->second;
+}
+
+void sync_store::clear() {
+	entries_.clear();
+	seen_.clear();
+	tracking_ = true;
+}
+
+void sync_store::update_(sync_state state, std::string_view uuid, LDAP * connection, entry_t entry) {
+	std::string key{uuid};
+
+	if (state == sync_state::remove) {
+		entries_.erase(key);
+		return;
+	}
+
+	if (tracking_) seen_.insert(key);
+	if (state == sync_state::present) return;
+
+	sync_store::entry & stored = entries_[key];
+	char * dn = ldap_get_dn(connection, entry);
+	if (dn) {
+		stored.dn = dn;
+		ldap_memfree(dn);
+	}
+
+	// The server sends all requested attributes for added and modified entries.
+	// Attributes may be sent without values if the query asked for attribute names only.
+	stored.attributes.clear();
+	walk_attributes(connection, entry, [&] (char const * attribute) {
+		std::vector<std::string> & values = stored.attributes[attribute];
+		berval * * raw_values = ldap_get_values_len(connection, entry, attribute);
+		if (!raw_values) return;
+		auto free_values = at_scope_exit([raw_values] () { ldap_value_free_len(raw_values); });
+		int count = ldap_count_values_len(raw_values);
+		for (int i = 0; i < count; ++i) values.emplace_back(raw_values[i]->bv_val, raw_values[i]->bv_len);
+	});
+}
+
+void sync_store::update_(std::vector<std::string_view> const & uuids, bool deleted) {
+	for (std::string_view uuid : uuids) {
+		if (deleted) entries_.erase(std::string{uuid});
+		else if (tracking_) seen_.emplace(uuid);
+	}
+}
+
+void sync_store::present_phase_done_() {
+	for (auto i = entries_.begin(); i != entries_.end();) {
+		if (seen_.count(i->first)) ++i;
+		else i = entries_.erase(i);
+	}
+	seen_.clear();
+}
+
+std::string format_uuid(std::string_view uuid) {
+	constexpr char const * digits = "0123456789abcdef";
+	std::string result;
+	result.reserve(uuid.size() * 2 + 4);
+	for (std::size_t i = 0; i < uuid.size(); ++i) {
+		if (i == 4 || i == 6 || i == 8 || i == 10) result.push_back('-');
+		unsigned char byte = uuid[i];
+		result.push_back(digits[byte >> 4]);
+		result.push_back(digits[byte & 0xf]);
+	}
+	return result;
+}
+
+}
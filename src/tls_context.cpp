@@ -0,0 +1,75 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tls_context.hpp"
+#include "options.hpp"
+#include "util.hpp"
+
+#ifdef LDAPXX_HAVE_OPENSSL
+#include <openssl/ssl.h>
+#endif
+
+#ifdef LDAPXX_HAVE_LDAP_PVT_TLS_CTX_FREE
+// Not part of the public API of libldap, but exported by it. Detected by CMake.
+extern "C" void ldap_pvt_tls_ctx_free(void * context);
+#endif
+
+namespace ldapxx {
+
+tls_context::tls_context(connection_options::tls_options const & options) {
+	// Build the context on a handle that is never connected.
+	LDAP * ldap = nullptr;
+	if (int code = ldap_initialize(&ldap, nullptr)) throw error{errc(code), "initializing LDAP handle for TLS context"};
+	auto unbind = at_scope_exit([ldap] () { ldap_unbind_ext_s(ldap, nullptr, nullptr); });
+
+	connection_options::tls_options file_options = options;
+	file_options.context       = nullptr;
+	file_options.session_cache = nullptr;
+	apply_options(ldap, file_options);
+
+	set_tls_new_context(ldap);
+	native_ = get_tls_context(ldap);
+	if (!native_) throw error{errc::local_error, "creating TLS context"};
+
+	try {
+		openssl_ = get_option<std::string>(ldap, LDAP_OPT_X_TLS_PACKAGE) == "OpenSSL";
+	} catch (error const &) {}
+}
+
+tls_context::~tls_context() {
+#ifdef LDAPXX_HAVE_OPENSSL
+	// With OpenSSL, the native context is an SSL_CTX, and libldap counts references with SSL_CTX_up_ref().
+	if (openssl_) {
+		SSL_CTX_free(static_cast<SSL_CTX *>(native_));
+		return;
+	}
+#endif
+#ifdef LDAPXX_HAVE_LDAP_PVT_TLS_CTX_FREE
+	ldap_pvt_tls_ctx_free(native_);
+#endif
+}
+
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tls_session_cache.hpp"
+#include "options.hpp"
+
+#ifdef LDAPXX_HAVE_OPENSSL
+#include <openssl/ssl.h>
+#endif
+
+namespace ldapxx {
+
+#ifdef LDAPXX_HAVE_OPENSSL
+/// OpenSSL callbacks that feed the TLS session cache.
+struct tls_session_callbacks {
+	/// Get the index of the SSL ex_data slot that links a TLS session to its server.
+	static int server_index() {
+		static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+		return index;
+	}
+
+	/// Get the index of the SSL ex_data slot that marks a TLS session whose handshake was counted.
+	static int counted_index() {
+		static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+		return index;
+	}
+
+	using new_session_callback = int (*) (SSL *, SSL_SESSION *);
+
+	/// Holds the replaced callback, since ex_data can only hold object pointers.
+	struct previous_callback {
+		new_session_callback callback;
+	};
+
+	static void free_previous_callback(void *, void * data, CRYPTO_EX_DATA *, int, long, void *) {
+		delete static_cast<previous_callback *>(data);
+	}
+
+	/// Get the index of the SSL_CTX ex_data slot that holds the new session callback we replaced.
+	static int previous_callback_index() {
+		static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, &free_previous_callback);
+		return index;
+	}
+
+	static tls_session_cache::server * get_server(SSL const * ssl) {
+		return static_cast<tls_session_cache::server *>(SSL_get_ex_data(ssl, server_index()));
+	}
+
+	/// Make a TLS context hand new sessions to on_new_session().
+	/**
+	 * Sessions may arrive after the handshake with TLS 1.3, so a callback is the only reliable way to get them.
+	 * A callback installed by the application is kept, and called before ours.
+	 */
+	static void configure(SSL_CTX * ctx) {
+		new_session_callback previous = SSL_CTX_sess_get_new_cb(ctx);
+		if (previous == &on_new_session) return;
+		if (previous) SSL_CTX_set_ex_data(ctx, previous_callback_index(), new previous_callback{previous});
+
+		// Keep client sessions out of the internal store, unless the application already caches them there.
+		long mode = SSL_CTX_get_session_cache_mode(ctx);
+		if (!(mode & SSL_SESS_CACHE_CLIENT)) mode |= SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE;
+		SSL_CTX_set_session_cache_mode(ctx, mode);
+		SSL_CTX_sess_set_new_cb(ctx, &on_new_session);
+	}
+
+	/// Called by libldap after the TLS session is created, but before the handshake is started.
+	static int on_connect(LDAP *, void * session, void *, void * arg) {
+		SSL * ssl = static_cast<SSL *>(session);
+		tls_session_cache::server & server = *static_cast<tls_session_cache::server *>(arg);
+
+		SSL_set_ex_data(ssl, server_index(), &server);
+		SSL_set_info_callback(ssl, &on_info);
+
+		std::lock_guard<std::mutex> lock{server.cache->mutex_};
+		if (server.session) SSL_set_session(ssl, static_cast<SSL_SESSION *>(server.session));
+		return 0;
+	}
+
+	/// Called by OpenSSL when the server issued a new session.
+	static int on_new_session(SSL * ssl, SSL_SESSION * session) {
+		int taken = 0;
+		auto * previous = static_cast<previous_callback *>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), previous_callback_index()));
+		if (previous) taken = previous->callback(ssl, session);
+
+		tls_session_cache::server * server = get_server(ssl);
+		if (!server) return taken;
+
+		// Returning 1 hands us the reference of OpenSSL, unless the previous callback already took it.
+		if (taken) SSL_SESSION_up_ref(session);
+		server->cache->store_(*server, session);
+		return 1;
+	}
+
+	/// Called by OpenSSL on state changes of a TLS session.
+	static void on_info(SSL const * ssl, int where, int) {
+		if (!(where & SSL_CB_HANDSHAKE_DONE)) return;
+
+		// With TLS 1.3, HANDSHAKE_DONE is also signalled for every NewSessionTicket after the handshake.
+		if (SSL_get_ex_data(ssl, counted_index())) return;
+		SSL_set_ex_data(const_cast<SSL *>(ssl), counted_index(), const_cast<SSL *>(ssl));
+
+		tls_session_cache::server * server = get_server(ssl);
+		if (server) server->cache->record_handshake_(SSL_session_reused(ssl));
+	}
+
+	static void free_session(void * session) {
+		SSL_SESSION_free(static_cast<SSL_SESSION *>(session));
+	}
+};
+#endif
+
+tls_session_cache::tls_session_cache() {
+#ifdef LDAPXX_HAVE_OPENSSL
+	// The callbacks hand OpenSSL objects to us, which only works if libldap uses OpenSSL too.
+	std::string package;
+	try {
+		package = get_option<std::string>(nullptr, LDAP_OPT_X_TLS_PACKAGE);
+	} catch (error const &) {}
+	if (package != "OpenSSL") throw error{errc::not_supported, "TLS session caching requires libldap with OpenSSL"};
+#else
+	throw error{errc::not_supported, "TLS session caching requires ldapxx to be built with OpenSSL"};
+#endif
+}
+
+tls_session_cache::~tls_session_cache() {
+	clear();
+}
+
+void tls_session_cache::attach(LDAP * connection) {
+#ifdef LDAPXX_HAVE_OPENSSL
+	std::string uri = get_option<std::string>(connection, LDAP_OPT_URI);
+
+	server * server;
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		server = &servers_.emplace(uri, tls_session_cache::server{this, nullptr}).first->second;
+	}
+
+	// Configure the TLS context once here rather than in the connect callback,
+	// which runs concurrently for connections that share a context.
+	// The context is created now if the connection doesn't have one yet, so the TLS options must be set already.
+	void * context = get_tls_context(connection);
+	if (!context) {
+		set_tls_new_context(connection);
+		context = get_tls_context(connection);
+		if (!context) throw error{errc::local_error, "creating TLS context"};
+	}
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+		tls_session_callbacks::configure(static_cast<SSL_CTX *>(context));
+	}
+	// Release the reference that get_tls_context() added. libldap counts SSL_CTX references with SSL_CTX_up_ref().
+	SSL_CTX_free(static_cast<SSL_CTX *>(context));
+
+	// The callback and its argument are passed directly rather than through a pointer.
+	if (int code = ldap_set_option(connection, LDAP_OPT_X_TLS_CONNECT_CB, reinterpret_cast<void *>(&tls_session_callbacks::on_connect))) {
+		throw error{errc(code), "setting TLS connect callback"};
+	}
+	if (int code = ldap_set_option(connection, LDAP_OPT_X_TLS_CONNECT_ARG, server)) {
+		throw error{errc(code), "setting TLS connect callback argument"};
+	}
+#else
+	// Unreachable, since the cache can't be constructed without OpenSSL.
+	(void) connection;
+#endif
+}
+
+void tls_session_cache::clear() {
+	std::lock_guard<std::mutex> lock{mutex_};
+	for (auto & entry : servers_) {
+#ifdef LDAPXX_HAVE_OPENSSL
+		if (entry.second.session) tls_session_callbacks::free_session(entry.second.session);
+#endif
+		entry.second.session = nullptr;
+	}
+}
+
+tls_session_stats tls_session_cache::stats() const {
+	tls_session_stats result;
+	result.handshakes = handshakes_.load(std::memory_order_relaxed);
+	result.resumed    = resumed_.load(std::memory_order_relaxed);
+	return result;
+}
+
+void tls_session_cache::record_handshake_(bool resumed) {
+	handshakes_.fetch_add(1, std::memory_order_relaxed);
+	if (resumed) resumed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void tls_session_cache::store_(server & server, void * session) {
+	std::lock_guard<std::mutex> lock{mutex_};
+#ifdef LDAPXX_HAVE_OPENSSL
+	if (server.session) tls_session_callbacks::free_session(server.session);
+#endif
+	server.session = session;
+}
+
+}
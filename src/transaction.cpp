@@ -0,0 +1,168 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "transaction.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+namespace ldapxx {
+
+namespace {
+	constexpr char const * start_transaction_oid = "1.3.6.1.1.21.1";
+	constexpr char const * transaction_spec_oid  = "1.3.6.1.1.21.2";
+	constexpr char const * end_transaction_oid   = "1.3.6.1.1.21.3";
+
+	/// Result code used by OpenLDAP to acknowledge that an operation was queued in a transaction.
+	constexpr int transaction_specify_okay = 0x4100;
+
+	/// Perform an extended operation and return the response value.
+	std::string extended_operation(connection connection, char const * oid, berval * data, std::chrono::milliseconds timeout, char const * details) {
+		int message_id = -1;
+		if (int code = ldap_extended_operation(connection, oid, data, nullptr, nullptr, &message_id)) throw error{errc(code), details};
+		owned_result result = connection.wait_result(message_id, timeout);
+
+		char * response_oid = nullptr;
+		berval * response   = nullptr;
+		int code = ldap_parse_extended_result(connection, result.get(), &response_oid, &response, 0);
+		auto free_response = at_scope_exit([&] () {
+			if (response_oid) ldap_memfree(response_oid);
+			if (response) ber_bvfree(response);
+		});
+		if (code) throw error{errc(code), details};
+
+		errc result_code = ldapxx::result_code(connection, result);
+		if (result_code != errc::success) throw error{result_code, details};
+		if (!response) return {};
+		return std::string{response->bv_val, response->bv_len};
+	}
+}
+
+transaction::transaction(ldapxx::connection connection, std::chrono::milliseconds timeout) :
+	connection_{connection},
+	timeout_{timeout}
+{
+	id_ = extended_operation(connection_, start_transaction_oid, nullptr, timeout_, "starting transaction");
+	if (id_.empty()) throw error{errc::protocol_error, "starting transaction: no transaction identifier received"};
+
+	control_.ldctl_oid        = const_cast<char *>(transaction_spec_oid);
+	control_.ldctl_value      = to_berval(id_);
+	control_.ldctl_iscritical = 1;
+	controls_ = {{&control_, nullptr}};
+}
+
+transaction::~transaction() {
+	if (finished_) return;
+	try {
+		abort();
+	} catch (...) {}
+}
+
+void transaction::check_active_() const {
+	if (finished_) throw error{errc::param_error, "queueing operation in finished transaction"};
+}
+
+void transaction::modify(std::string const & dn, std::vector<modification> const & modifications) {
+	buffer_.clear();
+	for (modification const & modification : modifications) buffer_.add(modification);
+	modify(dn, buffer_);
+}
+
+void transaction::modify(std::string const & dn, modification_buffer & modifications) {
+	check_active_();
+	pending_.push_back(connection_.modify_async(dn, modifications, controls_.data()));
+}
+
+void transaction::add_entry(std::string const & dn, std::map<std::string, std::vector<std::string>> const & attributes) {
+	buffer_.clear();
+	for (auto const & attribute : attributes) {
+		buffer_.add(modification_type::add, attribute.first, attribute.second.begin(), attribute.second.end());
+	}
+	add_entry(dn, buffer_);
+}
+
+void transaction::add_entry(std::string const & dn, modification_buffer & attributes) {
+	check_active_();
+	pending_.push_back(connection_.add_entry_async(dn, attributes, controls_.data()));
+}
+
+void transaction::remove_entry(std::string const & dn) {
+	check_active_();
+	pending_.push_back(connection_.remove_entry_async(dn, controls_.data()));
+}
+
+void transaction::collect_pending_() {
+	while (!pending_.empty()) {
+		owned_result result = connection_.wait_result(pending_.back(), timeout_);
+		pending_.pop_back();
+		errc code = result_code(connection_, result);
+		if (code != errc::success && int(code) != transaction_specify_okay) throw error{code, "queueing operation in transaction"};
+	}
+}
+
+void transaction::end_(bool commit) {
+	finished_ = true;
+
+	BerElement * ber = ber_alloc_t(LBER_USE_DER);
+	if (!ber) throw error{errc::no_memory, "encoding end transaction request"};
+	auto free_ber = at_scope_exit([ber] () { ber_free(ber, 1); });
+
+	// The commit field defaults to true, and DER requires default values to be omitted.
+	berval id = to_berval(id_);
+	int encoded = commit ? ber_printf(ber, "{O}", &id) : ber_printf(ber, "{bO}", ber_int_t(0), &id);
+	berval data;
+	if (encoded < 0 || ber_flatten2(ber, &data, 0) < 0) throw error{errc::encoding_error, "encoding end transaction request"};
+
+	extended_operation(connection_, end_transaction_oid, &data, timeout_, commit ? "committing transaction" : "aborting transaction");
+}
+
+void transaction::commit() {
+	check_active_();
+	try {
+		collect_pending_();
+	} catch (...) {
+		// Report why the commit failed, not why the abort failed too.
+		try {
+			abort();
+		} catch (...) {}
+		throw;
+	}
+	end_(true);
+}
+
+void transaction::abort() {
+	if (finished_) return;
+
+	// Read the responses to the queued operations so they don't linger on the connection.
+	for (int message_id : pending_) {
+		std::error_code error;
+		connection_.wait_result(message_id, timeout_, error);
+	}
+	pending_.clear();
+
+	end_(false);
+}
+
+}
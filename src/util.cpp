@@ -26,8 +26,51 @@
 
 #include "util.hpp"
 
+#include <cstdint>
+#include <cstdio>
+#include <ratio>
+
 namespace ldapxx {
 
+namespace {
+	using days = std::chrono::duration<std::int64_t, std::ratio<86400>>;
+
+	/// Count the days since 1970-01-01 of a date in the proleptic Gregorian calendar.
+	std::int64_t days_from_civil(std::int64_t year, unsigned int month, unsigned int day) {
+		year -= month <= 2;
+		std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+		unsigned int yoe = unsigned(year - era * 400);
+		unsigned int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+		unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		return era * 146097 + std::int64_t(doe) - 719468;
+	}
+
+	/// Convert days since 1970-01-01 to a date in the proleptic Gregorian calendar.
+	void civil_from_days(std::int64_t days, std::int64_t & year, unsigned int & month, unsigned int & day) {
+		days += 719468;
+		std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+		unsigned int doe = unsigned(days - era * 146097);
+		unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		unsigned int mp  = (5 * doy + 2) / 153;
+		day   = doy - (153 * mp + 2) / 5 + 1;
+		month = mp < 10 ? mp + 3 : mp - 9;
+		year  = std::int64_t(yoe) + era * 400 + (month <= 2);
+	}
+
+	/// Parse a fixed number of digits, removing them from the view.
+	boost::optional<unsigned int> parse_digits(std::string_view & input, std::size_t count) {
+		if (input.size() < count) return boost::none;
+		unsigned int result = 0;
+		for (std::size_t i = 0; i < count; ++i) {
+			if (input[i] < '0' || input[i] > '9') return boost::none;
+			result = result * 10 + (input[i] - '0');
+		}
+		input.remove_prefix(count);
+		return result;
+	}
+}
+
 std::vector<char const *> to_cstr_array(std::vector<std::string> const & input) {
 	std::vector<char const *> result;
 	result.reserve(input.size() + 1);
@@ -52,4 +95,92 @@ std::vector<berval> toBervals(std::vector<std::string> const & values) {
 	return result;
 }
 
+boost::optional<std::chrono::system_clock::time_point> parse_generalized_time(std::string_view value) {
+	using namespace std::chrono;
+
+	boost::optional<unsigned int> year  = parse_digits(value, 4);
+	boost::optional<unsigned int> month = parse_digits(value, 2);
+	boost::optional<unsigned int> day   = parse_digits(value, 2);
+	boost::optional<unsigned int> hour  = parse_digits(value, 2);
+	if (!year || !month || !day || !hour) return boost::none;
+	if (*month < 1 || *month > 12 || *day < 1 || *day > 31 || *hour > 23) return boost::none;
+
+	// Minutes and seconds are optional, and a fraction applies to the last unit present.
+	nanoseconds unit = hours{1};
+	nanoseconds time = hours{*hour};
+	if (boost::optional<unsigned int> minute = parse_digits(value, 2)) {
+		if (*minute > 59) return boost::none;
+		time += minutes{*minute};
+		unit  = minutes{1};
+		if (boost::optional<unsigned int> second = parse_digits(value, 2)) {
+			// Allow a leap second, which is folded into the next second.
+			if (*second > 60) return boost::none;
+			time += seconds{*second};
+			unit  = seconds{1};
+		}
+	}
+
+	if (!value.empty() && (value.front() == '.' || value.front() == ',')) {
+		value.remove_prefix(1);
+		nanoseconds scale = unit;
+		std::size_t digits = 0;
+		while (!value.empty() && value.front() >= '0' && value.front() <= '9') {
+			scale /= 10;
+			time  += scale * (value.front() - '0');
+			value.remove_prefix(1);
+			++digits;
+		}
+		if (digits == 0) return boost::none;
+	}
+
+	// The time zone is mandatory for LDAP: either Z or a UTC offset.
+	if (value.empty()) return boost::none;
+	char sign = value.front();
+	value.remove_prefix(1);
+	if (sign == 'Z') {
+		if (!value.empty()) return boost::none;
+	} else if (sign == '+' || sign == '-') {
+		boost::optional<unsigned int> offset_hours   = parse_digits(value, 2);
+		boost::optional<unsigned int> offset_minutes = value.empty() ? boost::optional<unsigned int>{0} : parse_digits(value, 2);
+		if (!offset_hours || !offset_minutes || !value.empty()) return boost::none;
+		nanoseconds offset = hours{*offset_hours} + minutes{*offset_minutes};
+		time += sign == '+' ? -offset : offset;
+	} else {
+		return boost::none;
+	}
+
+	auto since_epoch = days{days_from_civil(*year, *month, *day)} + time;
+	return system_clock::time_point{duration_cast<system_clock::duration>(since_epoch)};
+}
+
+std::string format_generalized_time(std::chrono::system_clock::time_point time) {
+	using namespace std::chrono;
+
+	nanoseconds since_epoch = duration_cast<nanoseconds>(time.time_since_epoch());
+	days date               = floor<days>(since_epoch);
+	seconds of_day          = floor<seconds>(since_epoch - date);
+	nanoseconds fraction    = since_epoch - date - of_day;
+
+	std::int64_t year;
+	unsigned int month;
+	unsigned int day;
+	civil_from_days(date.count(), year, month, day);
+
+	char buffer[48];
+	int length = std::snprintf(buffer, sizeof(buffer), "%04lld%02u%02u%02lld%02lld%02lld",
+		static_cast<long long>(year), month, day,
+		static_cast<long long>(of_day.count() / 3600),
+		static_cast<long long>(of_day.count() / 60 % 60),
+		static_cast<long long>(of_day.count() % 60)
+	);
+
+	// Add the fraction without trailing zeros, so equal points in time always get the same text.
+	if (fraction.count() != 0) {
+		length += std::snprintf(buffer + length, sizeof(buffer) - length, ".%09lld", static_cast<long long>(fraction.count()));
+		while (buffer[length - 1] == '0') --length;
+	}
+
+	return std::string{buffer, std::size_t(length)} + 'Z';
+}
+
 }
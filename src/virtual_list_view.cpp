@@ -0,0 +1,151 @@
+/*
+ * Copyright 2017 Maarten de Vries <maarten@de-vri.es>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "virtual_list_view.hpp"
+#include "util.hpp"
+#include "walk_result.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <utility>
+
+namespace ldapxx {
+
+namespace {
+	ber_int_t to_ber_int(std::size_t value) {
+		return ber_int_t(std::min<std::size_t>(value, INT_MAX));
+	}
+}
+
+virtual_list_view::virtual_list_view(ldapxx::connection connection, ldapxx::query query) :
+	connection_{connection},
+	query_{std::move(query)}
+{
+	if (query_.sort.empty()) throw error{errc::param_error, "creating virtual list view: the query has no sort keys"};
+}
+
+vlv_window virtual_list_view::fetch(std::size_t first, std::size_t count, operation_limits const & limits) {
+	std::error_code error;
+	vlv_window result = fetch(first, count, limits, error);
+	throw_if(error, "fetching virtual list view window");
+	return result;
+}
+
+vlv_window virtual_list_view::fetch(std::size_t first, std::size_t count, operation_limits const & limits, std::error_code & error) {
+	// The control counts positions from one. A content count of zero makes the offset absolute.
+	LDAPVLVInfo info{};
+	info.ldvlv_version      = 1;
+	info.ldvlv_before_count = 0;
+	info.ldvlv_after_count  = to_ber_int(count > 0 ? count - 1 : 0);
+	info.ldvlv_offset       = to_ber_int(first + 1);
+	info.ldvlv_count        = 0;
+	return fetch_(info, limits, error);
+}
+
+vlv_window virtual_list_view::fetch_around(std::string_view value, std::size_t before, std::size_t after, operation_limits const & limits) {
+	std::error_code error;
+	vlv_window result = fetch_around(value, before, after, limits, error);
+	throw_if(error, "fetching virtual list view window");
+	return result;
+}
+
+vlv_window virtual_list_view::fetch_around(std::string_view value, std::size_t before, std::size_t after, operation_limits const & limits, std::error_code & error) {
+	berval value_ber = to_berval(value);
+	LDAPVLVInfo info{};
+	info.ldvlv_version      = 1;
+	info.ldvlv_before_count = to_ber_int(before);
+	info.ldvlv_after_count  = to_ber_int(after);
+	info.ldvlv_attrvalue    = &value_ber;
+	return fetch_(info, limits, error);
+}
+
+vlv_window virtual_list_view::fetch_(LDAPVLVInfo & info, operation_limits const & limits, std::error_code & error) {
+	error = {};
+	vlv_window window{nullptr, 0, 0};
+
+	berval context = to_berval(context_);
+	if (!context_.empty()) info.ldvlv_context = &context;
+
+	LDAPControl * control = nullptr;
+	error = errc(ldap_create_vlv_control(connection_, &info, &control));
+	if (error) return window;
+	auto free_control = at_scope_exit([control] () { ldap_control_free(control); });
+	LDAPControl * controls[] = {control, nullptr};
+
+	if (limits.remaining().count() == 0) {
+		error = errc::timeout;
+		return window;
+	}
+
+	// The window bounds the number of entries already, so don't impose a size limit.
+	int message_id = connection_.search_async(query_, limits.time_limit(), 0, controls, error);
+	if (error) return window;
+	window.result = connection_.wait_result(message_id, limits, error);
+	if (error) return window;
+
+	LDAPMessage * message = find_search_result(connection_, window.result.get());
+	if (!message) {
+		error = errc::protocol_error;
+		return window;
+	}
+
+	int code = LDAP_OTHER;
+	LDAPControl * * response_controls = nullptr;
+	error = errc(ldap_parse_result(connection_, message, &code, nullptr, nullptr, nullptr, &response_controls, 0));
+	auto free_response_controls = at_scope_exit([&] () { if (response_controls) ldap_controls_free(response_controls); });
+	if (error) return window;
+	if (code != LDAP_SUCCESS) {
+		error = errc(code);
+		return window;
+	}
+
+	LDAPControl * response = ldap_control_find(LDAP_CONTROL_VLVRESPONSE, response_controls, nullptr);
+	if (!response) {
+		error = errc::not_supported;
+		return window;
+	}
+
+	ber_int_t target        = 0;
+	ber_int_t content_count = 0;
+	berval * new_context    = nullptr;
+	ber_int_t vlv_result    = LDAP_SUCCESS;
+	error = errc(ldap_parse_vlvresponse_control(connection_, response, &target, &content_count, &new_context, &vlv_result));
+	auto free_context = at_scope_exit([&] () { if (new_context) ber_bvfree(new_context); });
+	if (error) return window;
+	if (vlv_result != LDAP_SUCCESS) {
+		error = errc(vlv_result);
+		return window;
+	}
+
+	if (new_context) context_.assign(new_context->bv_val, new_context->bv_len);
+	else context_.clear();
+
+	window.target        = target > 0 ? std::size_t(target - 1) : 0;
+	window.content_count = content_count > 0 ? std::size_t(content_count) : 0;
+	return window;
+}
+
+}
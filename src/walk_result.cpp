@@ -115,4 +115,32 @@ std::multimap<std::string, std::string> entry_to_map(LDAP * connection, entry_t
 	return output;
 }
 
+errc result_code(LDAP * connection, result_t result) {
+	std::error_code error;
+	errc code = result_code(connection, result, error);
+	if (error) throw ldapxx::error{errc(error.value()), "parsing result"};
+	return code;
+}
+
+errc result_code(LDAP * connection, result_t result, std::error_code & error) {
+	error = {};
+	for (LDAPMessage * message = ldap_first_message(connection, result); message; message = ldap_next_message(connection, message)) {
+		int type = ldap_msgtype(message);
+		if (type == LDAP_RES_SEARCH_ENTRY || type == LDAP_RES_SEARCH_REFERENCE || type == LDAP_RES_INTERMEDIATE) continue;
+
+		int code = 0;
+		error = errc(ldap_parse_result(connection, message, &code, nullptr, nullptr, nullptr, nullptr, 0));
+		return errc(code);
+	}
+	error = errc::no_results_returned;
+	return errc::no_results_returned;
+}
+
+LDAPMessage * find_search_result(LDAP * connection, LDAPMessage * result) {
+	for (LDAPMessage * message = ldap_first_message(connection, result); message; message = ldap_next_message(connection, message)) {
+		if (ldap_msgtype(message) == LDAP_RES_SEARCH_RESULT) return message;
+	}
+	return nullptr;
+}
+
 }